@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "intrinsic.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -17,31 +18,62 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* 8254 input frequency, and input clocks per timer tick rounded
+   to nearest. */
+#define PIT_HZ 1193180
+#define TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
 // 시스템이 부팅된 이후 경과한 타이머 틱(tick)의 수를 저장
 static int64_t ticks; 
 
 // Number of loops per timer tick. Initialized by timer_calibrate().
 static unsigned loops_per_tick;
 
+/* Time stamp counter frequency, measured against the PIT by
+   timer_calibrate(), and the counter value at that point, which
+   is taken as time TSC_BASE_TICK. */
+#define TSC_CALIBRATE_TICKS 5
+#define NS_PER_SEC 1000000000ULL
+static uint64_t tsc_hz;
+static uint64_t tsc_base;
+static int64_t tsc_base_tick;
+
+/* If true, stop the periodic tick while the CPU is idle or only
+   one thread is runnable, and program a one-shot interrupt for the
+   next sleeper instead.  Controlled by kernel command-line option
+   "-tickless". */
+bool timer_tickless;
+
+/* Tickless state.  While ONESHOT_END is nonzero, counter 0 runs in
+   mode 0 (interrupt on terminal count), loaded with ONESHOT_COUNT,
+   and fires at the tick boundary where TICKS becomes ONESHOT_END.
+   Tick boundaries fall every TICK_COUNT input clocks before that,
+   so the number already passed can be read back from the counter. */
+static int64_t oneshot_end;
+static unsigned oneshot_count;
+static bool calibrated;          /* No tickless before calibration. */
+static int64_t timer_interrupts; /* # of timer interrupts taken. */
+
 // 함수 선언
 static intr_handler_func timer_interrupt; // 인터럽트때마다 틱을 하나씩 올려주는 함수 based on 8254 Timer
 static bool too_many_loops (unsigned loops); // 루프의 횟수가 너무 많은지를 판단하는 함수. 틱당 루프의 수를 조정하기 위한
 static void busy_wait (int64_t loops); // 지정된 횟수만큼 바쁘게 루프를도는 함수 for 정확한 딜레이 of stopped thread
 static void real_time_sleep (int64_t num, int32_t denom); // 주어진 시간 동안 대기(슬립)하는 함수
+static void tsc_calibrate (void);
+static void pit_periodic (void);
+static void pit_oneshot (unsigned count);
+static unsigned pit_read (void);
+static bool tick_pending (void);
+static unsigned oneshot_remaining (void);
+static void tickless_advance (int64_t to);
+static void tickless_sync (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 // 하드웨어 타이머를 설정하여 일정 주기마다 인터럽트를 발생시키는 것
 void timer_init (void) {
-	/* 8254 input frequency divided by TIMER_FREQ, rounded to
-	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ; //타이머 칩에 입력되는 기본 클럭 주파수(
-
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
-
+	pit_periodic ();
 	intr_register_ext (0x20, timer_interrupt, "");
 }
 
@@ -68,11 +100,59 @@ void timer_calibrate (void) {
 			loops_per_tick |= test_bit;
 
 	printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+	tsc_calibrate ();
+	calibrated = true;
+}
+
+/* Measures the TSC frequency over TSC_CALIBRATE_TICKS whole timer
+   ticks.  Each end is taken right after a tick boundary. */
+static void
+tsc_calibrate (void) {
+	int64_t start;
+	uint64_t tsc_start;
+
+	ASSERT (intr_get_level () == INTR_ON);
+	printf ("Calibrating TSC...  ");
+
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	start = ticks;
+	tsc_start = rdtsc ();
+
+	while (ticks < start + TSC_CALIBRATE_TICKS)
+		barrier ();
+	tsc_base = rdtsc ();
+	tsc_base_tick = start + TSC_CALIBRATE_TICKS;
+	tsc_hz = (tsc_base - tsc_start) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+
+	printf ("%'"PRIu64" Hz.\n", tsc_hz);
+}
+
+/* Returns nanoseconds since the OS booted, from the TSC.  Before
+   timer_calibrate() has run, only whole timer ticks are counted.
+   Monotonic, and cheap enough to call in a loop; may be called
+   with interrupts in any state. */
+uint64_t
+timer_now_ns (void) {
+	uint64_t cycles;
+
+	if (tsc_hz == 0)
+		return (uint64_t) ticks * (NS_PER_SEC / TIMER_FREQ);
+
+	/* Split the conversion so that CYCLES * NS_PER_SEC cannot
+	   overflow. */
+	cycles = rdtsc () - tsc_base;
+	return (uint64_t) tsc_base_tick * (NS_PER_SEC / TIMER_FREQ)
+	       + cycles / tsc_hz * NS_PER_SEC
+	       + cycles % tsc_hz * NS_PER_SEC / tsc_hz;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t timer_ticks (void) {
 	enum intr_level old_level = intr_disable (); // 인터럽트를 비활성화,  이전 인터럽트 상태를 old_level 변수에 저장
+	tickless_sync ();
 	int64_t t = ticks; // 전역 변수 ticks의 현재 값을 t라는 지역 변수에 복사
 	intr_set_level (old_level);//이전의 인터럽트 상태(old_level)를 복원
 	barrier ();
@@ -122,10 +202,103 @@ timer_nsleep (int64_t ns) {
 void
 timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+	if (timer_tickless)
+		printf ("Timer: %"PRId64" interrupts (tickless)\n", timer_interrupts);
+}
+
+/* Stops the periodic tick, if tickless mode is on, by programming
+   a one-shot interrupt for the next sleeper's wakeup tick.  Called
+   with interrupts off by the idle thread right before it halts,
+   and by the timer interrupt when only one thread is runnable. */
+void
+timer_tickless_enter (void) {
+	int64_t deadline, n, max_n;
+	unsigned r;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (!timer_tickless || !calibrated || oneshot_end != 0)
+		return;
+
+	/* A tick boundary that has passed but not been counted yet
+	   would put TICKS behind the period read below. */
+	if (tick_pending ())
+		return;
+
+	deadline = thread_next_wakeup ();
+	if (thread_mlfqs) {
+		/* load_avg is sampled on every whole second. */
+		int64_t second = ROUND_DOWN (ticks, TIMER_FREQ) + TIMER_FREQ;
+		if (deadline > second)
+			deadline = second;
+	}
+
+	/* The current period ends in R input clocks; the 16-bit counter
+	   covers only a few more whole ticks after that. */
+	r = pit_read ();
+	max_n = 1 + (UINT16_MAX - r) / TICK_COUNT;
+	n = deadline - ticks;
+	if (n > max_n)
+		n = max_n;
+	if (n < 2)
+		return;
+
+	oneshot_count = r + (n - 1) * TICK_COUNT;
+	oneshot_end = ticks + n;
+	pit_oneshot (oneshot_count);
+}
+
+/* Restarts the periodic tick after timer_tickless_enter(), because
+   another thread became runnable or the running thread is about
+   to be switched out.  TICKS is brought up to date and the one-shot
+   is cut short to fire on the next tick boundary, where the timer
+   interrupt switches back to periodic mode without losing phase. */
+void
+timer_tickless_exit (void) {
+	unsigned r, left;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (oneshot_end == 0)
+		return;
+
+	/* Already expired: the pending interrupt finishes the job. */
+	r = oneshot_remaining ();
+	if (r == 0)
+		return;
+
+	left = DIV_ROUND_UP (r, TICK_COUNT);
+	tickless_advance (oneshot_end - left);
+	if (left > 1) {
+		oneshot_count = r - (left - 1) * TICK_COUNT;
+		oneshot_end = ticks + 1;
+		pit_oneshot (oneshot_count);
+	}
 }
 
 /* Timer interrupt handler. */
 static void timer_interrupt (struct intr_frame *args UNUSED) {
+	timer_interrupts++;
+	if (oneshot_end != 0) {
+		/* A periodic tick that came in while the one-shot was being
+		   armed.  timer_tickless_enter() measured the one-shot from
+		   the period after it, so count its boundary here and move
+		   the end of the one-shot along with TICKS. */
+		if (oneshot_remaining () != 0) {
+			ticks++;
+			oneshot_end++;
+			thread_tick ();
+			tickless_sync ();
+			return;
+		}
+
+		/* The one-shot expired: the ticks in between were skipped,
+		   and this interrupt is the last one. */
+		tickless_advance (oneshot_end - 1);
+		oneshot_end = 0;
+		pit_periodic ();
+	}
+
 	ticks++;
 	thread_tick ();
 	if (thread_mlfqs) {
@@ -133,15 +306,95 @@ static void timer_interrupt (struct intr_frame *args UNUSED) {
 
 		if (ticks % TIMER_FREQ == 0) {  // Every second
 			mlfqs_calculate_load_avg();  // Recalculate system load average
-			mlfqs_recalculate_recent_cpu();  // Recalculate recent_cpu for all threads
+			mlfqs_request_recalculation();  // Decay recent_cpu of all threads, outside the handler
 		}
 
-		if (ticks % 4 == 0) {  // Every 4 ticks, recalculate priorities
-			mlfqs_recalculate_priority();  // Recalculate priorities of all threads
+		if (ticks % 4 == 0) {  // Every 4 ticks, only the running thread's recent_cpu has changed
+			mlfqs_calculate_priority(thread_current());
 		}
 	}
 
 	thread_awake(ticks);  // Wake up sleeping threads
+
+	/* mlfqs charges recent_cpu to the running thread on every tick. */
+	if (!thread_mlfqs && thread_is_alone ())
+		timer_tickless_enter ();
+}
+
+/* Programs counter 0 to interrupt every TICK_COUNT input clocks. */
+static void
+pit_periodic (void) {
+	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+	outb (0x40, TICK_COUNT & 0xff);
+	outb (0x40, TICK_COUNT >> 8);
+}
+
+/* Programs counter 0 to interrupt once, COUNT input clocks from
+   now. */
+static void
+pit_oneshot (unsigned count) {
+	ASSERT (count > 0 && count <= UINT16_MAX);
+
+	outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
+}
+
+/* Returns the current value of counter 0. */
+static unsigned
+pit_read (void) {
+	uint8_t lo, hi;
+
+	outb (0x43, 0x00);    /* CW: latch counter 0. */
+	lo = inb (0x40);
+	hi = inb (0x40);
+	return lo | (hi << 8);
+}
+
+/* Returns true if the timer has raised an interrupt that the CPU
+   has not taken yet, according to the master PIC's interrupt
+   request register. */
+static bool
+tick_pending (void) {
+	outb (0x20, 0x0a);    /* OCW3: read the IRR on the next read. */
+	return (inb (0x20) & 0x01) != 0;
+}
+
+/* Returns the input clocks left before the armed one-shot fires,
+   or 0 if it has already reached terminal count.  In mode 0 the
+   output pin goes high at terminal count, after which the counter
+   wraps around past ONESHOT_COUNT. */
+static unsigned
+oneshot_remaining (void) {
+	unsigned r;
+
+	outb (0x43, 0xe2);    /* Read-back: status of counter 0 only. */
+	if (inb (0x40) & 0x80)
+		return 0;
+	r = pit_read ();
+	return r <= oneshot_count ? r : 0;
+}
+
+/* Moves TICKS forward to TO, charging the ticks that went by
+   without an interrupt to the running thread. */
+static void
+tickless_advance (int64_t to) {
+	if (to > ticks) {
+		thread_account_ticks (to - ticks);
+		ticks = to;
+	}
+}
+
+/* While a one-shot is armed, folds the tick boundaries it has
+   already passed into TICKS, so timer_ticks() stays exact. */
+static void
+tickless_sync (void) {
+	unsigned r;
+
+	if (oneshot_end == 0)
+		return;
+	r = oneshot_remaining ();
+	tickless_advance (oneshot_end - (r == 0 ? 1 : DIV_ROUND_UP (r, TICK_COUNT)));
 }
 
 // 루프의 반복 횟수(loops)가 타이머 틱(tick) 하나를 초과하여 기다리게 하는지 여부를 확인
@@ -199,10 +452,19 @@ real_time_sleep (int64_t num, int32_t denom) {
 		   timer_sleep() because it will yield the CPU to other
 		   processes. */
 		timer_sleep (ticks);
+	} else if (tsc_hz != 0) {
+		/* Otherwise, spin on the TSC for accurate sub-tick timing.
+		   NUM / DENOM is below one tick here, so NUM * NS_PER_SEC
+		   cannot overflow. */
+		if (num > 0) {
+			uint64_t end = timer_now_ns () + (uint64_t) num * NS_PER_SEC / denom;
+			while (timer_now_ns () < end)
+				asm volatile ("pause" : : : "memory");
+		}
 	} else {
-		/* Otherwise, use a busy-wait loop for more accurate
-		   sub-tick timing.  We scale the numerator and denominator
-		   down by 1000 to avoid the possibility of overflow. */
+		/* Before the TSC is calibrated, use a busy-wait loop.  We
+		   scale the numerator and denominator down by 1000 to avoid
+		   the possibility of overflow. */
 		ASSERT (denom % 1000 == 0);
 		busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 	}
@@ -0,0 +1,71 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+ *
+ * This is an intrusive pairing heap.  Like lists and hash
+ * tables, it does no dynamic allocation: each structure that can
+ * be in a heap embeds a struct heap_elem member, and heap_entry
+ * converts a struct heap_elem back to the structure that
+ * contains it.
+ *
+ * The heap is ordered by a caller-supplied "less" function and
+ * heap_top() returns a maximum element.  Elements that compare
+ * equal come out in the order they were pushed, so a heap can
+ * stand in for a list kept sorted with list_insert_ordered().
+ *
+ * If an element's key changes while it is in the heap, call
+ * heap_update() on it; it keeps the element's place among
+ * equals.
+ *
+ * Costs (amortized): push and top are O(1); pop, remove and
+ * update are O(log n). */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+	struct heap_elem *child;    /* First child. */
+	struct heap_elem *next;     /* Next sibling. */
+	struct heap_elem *prev;     /* Previous sibling, or parent. */
+	uint64_t seq;               /* Push order, breaks ties. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+ * the structure that HEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+	((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child            \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+		const struct heap_elem *b,
+		void *aux);
+
+/* Heap. */
+struct heap {
+	struct heap_elem *root;     /* Maximum element, or null. */
+	size_t elem_cnt;            /* Number of elements. */
+	uint64_t seq;               /* Next push order. */
+	heap_less_func *less;       /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (const struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,69 @@
+#ifndef __LIB_KERNEL_TREE_H
+#define __LIB_KERNEL_TREE_H
+
+/* Ordered set.
+ *
+ * This is an intrusive binary search tree, kept balanced as a
+ * treap.  Like lists and hash tables, it does no dynamic
+ * allocation: each structure that can be in a tree embeds a
+ * struct tree_elem member, and tree_entry converts a struct
+ * tree_elem back to the structure that contains it.
+ *
+ * The tree is ordered by a caller-supplied "less" function, and
+ * no two elements in a tree may compare equal.  Besides exact
+ * lookup, tree_ceil() and tree_next() find the nearest elements
+ * at or above a key, which is what a hash table cannot do.
+ * Lookups take a dummy element holding the key, as with
+ * hash_find().
+ *
+ * Costs (expected): insert, delete, find, ceil and next are
+ * O(log n). */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct tree_elem {
+	struct tree_elem *left;     /* Smaller elements. */
+	struct tree_elem *right;    /* Larger elements. */
+	unsigned priority;          /* Heap order, for balance. */
+};
+
+/* Converts pointer to tree element TREE_ELEM into a pointer to
+ * the structure that TREE_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the tree element. */
+#define tree_entry(TREE_ELEM, STRUCT, MEMBER)                   \
+	((STRUCT *) ((uint8_t *) &(TREE_ELEM)->left             \
+		- offsetof (STRUCT, MEMBER.left)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool tree_less_func (const struct tree_elem *a,
+		const struct tree_elem *b,
+		void *aux);
+
+/* Tree. */
+struct tree {
+	struct tree_elem *root;     /* Root, or null. */
+	size_t elem_cnt;            /* Number of elements. */
+	unsigned seed;              /* Source of element priorities. */
+	tree_less_func *less;       /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void tree_init (struct tree *, tree_less_func *, void *aux);
+
+struct tree_elem *tree_insert (struct tree *, struct tree_elem *);
+struct tree_elem *tree_delete (struct tree *, struct tree_elem *);
+struct tree_elem *tree_find (const struct tree *, const struct tree_elem *);
+struct tree_elem *tree_ceil (const struct tree *, const struct tree_elem *);
+struct tree_elem *tree_next (const struct tree *, const struct tree_elem *);
+struct tree_elem *tree_first (const struct tree *);
+
+size_t tree_size (const struct tree *);
+bool tree_empty (const struct tree *);
+
+#endif /* lib/kernel/tree.h */
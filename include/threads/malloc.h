@@ -4,7 +4,18 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of malloc() size classes: 16, 32, ..., 1024 bytes. */
+#define MALLOC_CLASS_CNT 7
+
+/* Per-thread cache of free blocks of one size class, so that
+   most malloc() and free() calls need no lock. */
+struct malloc_magazine {
+	void *head;                 /* First block; each links to the next. */
+	size_t cnt;                 /* Number of blocks. */
+};
+
 void malloc_init (void);
+void malloc_thread_exit (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
@@ -28,6 +28,15 @@
 #define PTX(la)  ((((uint64_t) (la)) >> PTXSHIFT) & 0x1FF)
 #define PTE_ADDR(pte) ((uint64_t) (pte) & ~0xFFF)
 
+/* A page-directory entry with PTE_PS set maps a 2 MB huge page,
+   which must be aligned to its size in both virtual and physical
+   memory, instead of pointing to a page table. */
+#define HPGSIZE   (1UL << PDXSHIFT)        /* Bytes in a huge page. */
+#define HPG_PAGES (HPGSIZE / PGSIZE)       /* Pages in a huge page. */
+
+/* Round down to nearest huge page boundary. */
+#define hpg_round_down(va) ((void *) ((uint64_t) (va) & ~(HPGSIZE - 1)))
+
 /* The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
    ignored.
@@ -41,5 +50,6 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=huge page (PDEs only). */
 
 #endif /* threads/pte.h */
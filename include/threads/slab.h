@@ -0,0 +1,27 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object caches.
+
+   A cache hands out objects of one fixed size, packed into
+   page-sized slabs obtained from palloc_get_page() with no
+   rounding beyond pointer alignment.  If the cache has a
+   constructor, every object is constructed once, when its slab
+   first gives it out.  After that it must be handed back to
+   kmem_cache_free() in its constructed state. */
+
+struct kmem_cache;
+
+/* Initializes a newly carved object OBJ. */
+typedef void kmem_ctor_func (void *obj);
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+		kmem_ctor_func *ctor);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_cache_print_stats (void);
+
+#endif /* threads/slab.h */
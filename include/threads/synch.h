@@ -1,13 +1,14 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */ // 공유 자원의 계수?
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiting threads, highest priority on top. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -20,6 +21,8 @@ void sema_self_test (void);
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct heap donors;         /* Waiting threads, highest priority on top. */
+	struct list_elem elem;      /* Element in holder's held_locks. */
 };
 
 void lock_init (struct lock *);
@@ -28,9 +31,12 @@ bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+struct thread;
+void update_priority (struct thread *);
+
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiters, highest priority on top. */
 };
 
 void cond_init (struct condition *);
@@ -38,6 +44,24 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *cond, struct lock *lock);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock.  Any number of readers or a single writer
+   may hold it at a time.  Writers are preferred: once a writer
+   is waiting, new readers queue up behind it. */
+struct rwlock {
+	struct lock lock;           /* Held by the writer. */
+	unsigned readers;           /* # of readers holding the lock. */
+	struct list reader_list;    /* Readers that a writer donates to. */
+	struct thread *writer;      /* Writer waiting for readers to leave. */
+	struct semaphore drained;   /* Upped when the last reader leaves. */
+};
+
+void rw_init (struct rwlock *);
+void rw_read_acquire (struct rwlock *);
+void rw_read_release (struct rwlock *);
+void rw_write_acquire (struct rwlock *);
+void rw_write_release (struct rwlock *);
+bool rw_write_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
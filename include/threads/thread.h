@@ -5,6 +5,7 @@
 #include <list.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 //(P2:syscall) fork
 #include "threads/synch.h"
 #ifdef VM
@@ -88,11 +89,12 @@ typedef int tid_t;
  * set to THREAD_MAGIC.  Stack overflow will normally change this
  * value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
- * the run queue (thread.c), or it can be an element in a
- * semaphore wait list (synch.c).  It can be used these two ways
- * only because they are mutually exclusive: only a thread in the
- * ready state is on the run queue, whereas only a thread in the
- * blocked state is on a semaphore wait list. */
+ * the run queue (thread.c), or it can be an element in the sleep
+ * wheel (thread.c).  It can be used these two ways only because
+ * they are mutually exclusive: only a thread in the ready state
+ * is on the run queue, whereas only a blocked thread sleeps.
+ * A thread blocked on a semaphore is in the semaphore's waiter
+ * heap through `wait_elem' instead. */
 struct thread {
 	/* Owned by thread.c. */
 	tid_t tid;                          /* Thread identifier. */
@@ -104,8 +106,11 @@ struct thread {
 	//(P1:donation)
 	int org_priority;
 	struct lock* wait_on_lock;
-	struct list_elem donation_elem;         
-	struct list donations;
+	struct heap_elem donation_elem;     /* Element in wait_on_lock's donors. */
+	struct list held_locks;             /* Locks held, for update_priority(). */
+	struct rwlock *read_lock;           /* Rwlock read with donation, if any. */
+	struct list_elem read_elem;         /* Element in read_lock's readers. */
+	struct rwlock *wait_on_rw;          /* Rwlock whose readers we wait out. */
 
 	//(P1:mlfqs)
 	int recent_cpu;
@@ -114,6 +119,12 @@ struct thread {
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
+	struct heap_elem wait_elem;         /* Element in a semaphore's waiters. */
+	struct heap *wait_queue;            /* Wait queue ordered by our priority. */
+	struct heap_elem *wait_node;        /* Our element in wait_queue. */
+
+	/* Owned by threads/malloc.c. */
+	struct malloc_magazine malloc_mags[MALLOC_CLASS_CNT];
 	// (P2:syscall)
 	bool is_user;
 	struct list child_list; //fork시에 부모 자식 관계 리스트
@@ -138,6 +149,7 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	uint64_t user_rsp;                  /* User rsp at the last system call. */
 #endif
 
 	/* Owned by thread.c. */
@@ -154,6 +166,8 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_account_ticks (int64_t);
+bool thread_is_alone (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -169,8 +183,14 @@ const char *thread_name (void);
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 
+// (P1: Alarm clock): thread 재우고 깨우고
+void thread_sleep (int64_t ticks);
+void thread_awake (int64_t current_ticks);
+int64_t thread_next_wakeup (void);
+
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_change_priority (struct thread *, int priority);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -178,9 +198,6 @@ int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
 void do_iret (struct intr_frame *tf);
-bool priority_compare(const struct list_elem *a, const struct list_elem *b, void *aux );
-bool ticks_compare(const struct list_elem *a, const struct list_elem *b, void *aux);
-bool sema_compare(const struct list_elem *a, const struct list_elem *b, void *aux );
 
 
 //(P:mlfqs)
@@ -190,6 +207,7 @@ void mlfqs_calculate_load_avg(void);
 void mlfqs_increment_recent_cpu(void);
 void mlfqs_recalculate_recent_cpu(void);
 void mlfqs_recalculate_priority(void);
+void mlfqs_request_recalculation(void);
 
 
 void preempt(void);
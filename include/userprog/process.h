@@ -13,4 +13,7 @@ void process_activate (struct thread *next);
 //(P2:syscall) fork
 struct thread *get_child_process(int pid);
 
+//(P2:args) Pushes the arguments of the new process onto its stack
+void argument_stack(char **parse, int count, void **rsp);
+
 #endif /* userprog/process.h */
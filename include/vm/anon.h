@@ -5,9 +5,14 @@ struct page;
 enum vm_type;
 
 struct anon_page {
+	size_t slot;            /* Swap slot, or BITMAP_ERROR if none. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_swap_cluster (size_t cnt);
+bool anon_swap_available (void);
+void anon_copy_swapped (struct page *page);
+void vm_anon_print_stats (void);
 
 #endif
@@ -6,7 +6,22 @@
 struct page;
 enum vm_type;
 
+/* A page of a file, with any bytes past READ_BYTES zero.
+ *
+ * A private page, such as a page of an executable, becomes
+ * anonymous when it is first written.  A page of a shared mapping
+ * created by mmap() stays a file page, and what is written to it
+ * is written back to the file.
+ *
+ * The aux of an uninitialized VM_FILE page must be a malloc()'d
+ * struct file_page holding a reference to INODE, which the page
+ * takes over when it is initialized. */
 struct file_page {
+	struct inode *inode;    /* Inode the page is read from. */
+	off_t ofs;              /* Offset of the page in INODE. */
+	size_t read_bytes;      /* Bytes read from INODE. */
+	bool shared;            /* Part of a shared mapping? */
+	void *map_addr;         /* If shared, where the mapping starts. */
 };
 
 void vm_file_init (void);
@@ -14,4 +29,7 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+void do_msync (void *va);
+void file_backed_write_back (const struct file_page *file_page,
+		const void *kva);
 #endif
@@ -1,6 +1,8 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <tree.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -46,6 +48,11 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct thread *owner;  /* Process whose address space has it. */
+	bool writable;         /* Mapped writable into user space? */
+	struct hash_elem spt_elem;   /* Supplemental page table by VA. */
+	struct tree_elem range_elem; /* Supplemental page table, ordered. */
+	struct list_elem frame_elem; /* Element in the frame's page list. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -63,6 +70,12 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list_elem elem;  /* Element in the frame table. */
+	struct list pages;      /* Every page mapped to the frame. */
+	unsigned pin_cnt;       /* Never chosen for eviction if nonzero. */
+	bool dirty;             /* Written by a page no longer mapped? */
+	struct hash_elem file_elem; /* Element in the file frame cache. */
+	struct file_page source;    /* If cached, what the frame holds. */
 };
 
 /* The function table for page operations.
@@ -82,11 +95,21 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * Every page is in both a hash table, for the O(1) lookup of a
+ * single address that every page fault needs, and an ordered
+ * tree, for finding the pages within a range of addresses, as
+ * mmap, munmap and stack growth do. */
 struct supplemental_page_table {
+	struct hash pages;     /* Pages by VA. */
+	struct tree ranges;    /* The same pages, in VA order. */
+	uint8_t *seq_next;     /* Page a sequential fault would hit. */
+	size_t seq_window;     /* Pages to read past it if it does. */
+	uint8_t *stack_bottom; /* Lowest page of the stack. */
 };
 
+/* Maximum number of pages in a user stack, guard page included. */
+extern size_t stack_page_limit;
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
@@ -96,6 +119,12 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct page *spt_find_range (struct supplemental_page_table *spt,
+		void *start, void *end);
+struct page *spt_next_page (struct supplemental_page_table *spt,
+		struct page *page);
+void spt_write_back (struct supplemental_page_table *spt,
+		void *start, void *end);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -107,6 +136,14 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+bool vm_stack_reserved (const void *start, const void *end);
+struct frame *vm_get_free_frame (void);
+bool vm_install_frame (struct page *page, struct frame *frame);
+void vm_unpin_frame (struct frame *frame);
+bool vm_pin_buffer (const void *buffer, size_t size, bool write);
+void vm_unpin_buffer (const void *buffer, size_t size);
 enum vm_type page_get_type (struct page *page);
+const struct file_page *page_file_source (struct page *page);
+void vm_print_stats (void);
 
 #endif  /* VM_VM_H */
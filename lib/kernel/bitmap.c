@@ -27,6 +27,7 @@ typedef unsigned long elem_type;
 struct bitmap {
 	size_t bit_cnt;     /* Number of bits. */
 	elem_type *bits;    /* Elements that represent bits. */
+	size_t clear_hint;  /* Every bit below this one is true. */
 };
 
 /* Returns the index of the element that contains the bit
@@ -63,6 +64,42 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns a mask of the bits from START up to but not including
+   END, which must lie in the same element as START or be the
+   first bit of the next one. */
+static inline elem_type
+range_mask (size_t start, size_t end) {
+	size_t cnt = end - start;
+	elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+	return mask << (start % ELEM_BITS);
+}
+
+/* Returns the index of the first bit at or after START that is
+   in the same element as START or is the first bit of the next
+   one, but is not past END. */
+static inline size_t
+range_end (size_t start, size_t end) {
+	size_t next = (elem_idx (start) + 1) * ELEM_BITS;
+	return next < end ? next : end;
+}
+
+/* Returns element IDX of B with the bits that are set to VALUE
+   turned on and the rest turned off. */
+static inline elem_type
+elem_value (const struct bitmap *b, size_t idx, bool value) {
+	return value ? b->bits[idx] : ~b->bits[idx];
+}
+
+/* Returns the number of bits set to 1 in X.  The kernel is built
+   without libgcc, so __builtin_popcountl() is not available. */
+static inline size_t
+popcount (elem_type x) {
+	x = x - ((x >> 1) & 0x5555555555555555UL);
+	x = (x & 0x3333333333333333UL) + ((x >> 2) & 0x3333333333333333UL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (x * 0x0101010101010101UL) >> 56;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -75,6 +112,7 @@ bitmap_create (size_t bit_cnt) {
 	if (b != NULL) {
 		b->bit_cnt = bit_cnt;
 		b->bits = malloc (byte_cnt (bit_cnt));
+		b->clear_hint = 0;
 		if (b->bits != NULL || bit_cnt == 0) {
 			bitmap_set_all (b, false);
 			return b;
@@ -95,6 +133,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED) {
 
 	b->bit_cnt = bit_cnt;
 	b->bits = (elem_type *) (b + 1);
+	b->clear_hint = 0;
 	bitmap_set_all (b, false);
 	return b;
 }
@@ -160,6 +199,8 @@ bitmap_reset (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the AND instruction in [IA32-v2a]. */
 	asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+	if (bit_idx < b->clear_hint)
+		b->clear_hint = bit_idx;
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -174,6 +215,8 @@ bitmap_flip (struct bitmap *b, size_t bit_idx) {
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the XOR instruction in [IA32-v2b]. */
 	asm ("lock xorq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+	if (bit_idx < b->clear_hint)
+		b->clear_hint = bit_idx;
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -194,33 +237,49 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, one at a time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	if (!value && cnt > 0 && start < b->clear_hint)
+		b->clear_hint = start;
+	while (start < end) {
+		size_t stop = range_end (start, end);
+		elem_type *elem = &b->bits[elem_idx (start)];
+		elem_type mask = range_mask (start, stop);
+
+		if (value)
+			asm ("lock orq %1, %0" : "+m" (*elem) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "+m" (*elem) : "r" (~mask) : "cc");
+		start = stop;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t value_cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
 	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
+	while (start < end) {
+		size_t stop = range_end (start, end);
+		value_cnt += popcount (elem_value (b, elem_idx (start), value)
+				& range_mask (start, stop));
+		start = stop;
+	}
 	return value_cnt;
 }
 
@@ -228,15 +287,18 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
+	while (start < end) {
+		size_t stop = range_end (start, end);
+		if (elem_value (b, elem_idx (start), value) & range_mask (start, stop))
 			return true;
+		start = stop;
+	}
 	return false;
 }
 
@@ -263,25 +325,87 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 
 /* Finding set or unset bits. */
 
-/* Finds and returns the starting index of the first group of CNT
-   consecutive bits in B at or after START that are all set to
-   VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
-size_t
-bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or the number of bits in B if there is none.
+   Elements without such a bit are skipped whole. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value) {
+	size_t idx = elem_idx (start);
+	size_t last_idx = elem_cnt (b->bit_cnt);
+	elem_type x;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+
+	x = elem_value (b, idx, value) & ((elem_type) -1 << (start % ELEM_BITS));
+	while (x == 0) {
+		if (++idx >= last_idx)
+			return b->bit_cnt;
+		x = elem_value (b, idx, value);
+	}
+
+	/* The unused bits of the last element read as true when
+	   looking for false bits. */
+	start = idx * ELEM_BITS + __builtin_ctzl (x);
+	return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
+/* Does the work of bitmap_scan().  If FIRST is nonnull, stores in
+   *FIRST the index of the first bit set to VALUE that the search
+   came across, or the number of bits in B if there was none, or
+   leaves it unchanged if the search never started.
+
+   The search alternates between skipping to the next bit set to
+   VALUE and skipping to the end of its run, a word at a time. */
+static size_t
+scan (const struct bitmap *b, size_t start, size_t cnt, bool value,
+		size_t *first) {
+	size_t last;
+
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+	if (cnt > b->bit_cnt)
+		return BITMAP_ERROR;
+	if (cnt == 0)
+		return start;
+
+	last = b->bit_cnt - cnt;
+	if (!value && start < b->clear_hint)
+		start = b->clear_hint;
+	while (start <= last) {
+		size_t run = next_bit (b, start, value);
+		size_t end;
+
+		if (first != NULL) {
+			*first = run;
+			first = NULL;
+		}
+		if (run > last)
+			break;
+		end = next_bit (b, run, !value);
+		if (end - run >= cnt)
+			return run;
+		start = end;
 	}
 	return BITMAP_ERROR;
 }
 
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B at or after START that are all set to
+   VALUE.
+   If there is no such group, returns BITMAP_ERROR.
+
+   Searches for false bits begin no earlier than B's clear hint,
+   below which every bit is known to be true.  This lets the
+   common search for free space from the beginning of a mostly
+   full bitmap skip its full prefix.  The result is still the
+   first group at or after START. */
+size_t
+bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
+	return scan (b, start, cnt, value, NULL);
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -291,9 +415,17 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    setting them. */
 size_t
 bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t idx = bitmap_scan (b, start, cnt, value);
+	bool from_hint = !value && start <= b->clear_hint;
+	size_t first = BITMAP_ERROR;
+	size_t idx = scan (b, start, cnt, value, &first);
+
 	if (idx != BITMAP_ERROR)
 		bitmap_set_multiple (b, idx, cnt, !value);
+
+	/* Every bit from the old hint up to FIRST was true, and if the
+	   group started at FIRST, so is every bit in it now. */
+	if (from_hint && first != BITMAP_ERROR)
+		b->clear_hint = idx == first ? idx + cnt : first;
 	return idx;
 }
 
@@ -315,6 +447,7 @@ bitmap_read (struct bitmap *b, struct file *file) {
 		off_t size = byte_cnt (b->bit_cnt);
 		success = file_read_at (file, b->bits, size, 0) == size;
 		b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+		b->clear_hint = 0;
 	}
 	return success;
 }
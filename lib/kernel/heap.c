@@ -0,0 +1,197 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a tree in which every node is at least as
+   large as its children.  Each node points to its first child;
+   the children of a node form a doubly linked sibling list whose
+   first element's `prev' points back to the parent.  The root
+   has no siblings and a null `prev'.
+
+   Two heaps are melded by making the smaller root the first child
+   of the larger.  Popping the root melds its children in pairs
+   from left to right and then melds the pairs from right to
+   left, which is what gives the amortized O(log n) bound. */
+
+/* Returns true if A belongs above B in heap H: A is larger, or
+   they compare equal and A was pushed first. */
+static inline bool
+above (const struct heap *h, const struct heap_elem *a,
+		const struct heap_elem *b) {
+	if (h->less (b, a, h->aux))
+		return true;
+	if (h->less (a, b, h->aux))
+		return false;
+	return a->seq < b->seq;
+}
+
+/* Melds heaps rooted at A and B, which have no siblings, and
+   returns the new root. */
+static struct heap_elem *
+meld (const struct heap *h, struct heap_elem *a, struct heap_elem *b) {
+	if (above (h, b, a)) {
+		struct heap_elem *t = a;
+		a = b;
+		b = t;
+	}
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Melds the sibling list starting at FIRST into a single heap
+   and returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+merge_pairs (const struct heap *h, struct heap_elem *first) {
+	struct heap_elem *pairs = NULL;
+	struct heap_elem *root = NULL;
+
+	/* Left to right: meld adjacent pairs, stacking the results
+	   on PAIRS through their `next' links. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->next;
+
+		first = b != NULL ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b != NULL) {
+			b->next = b->prev = NULL;
+			a = meld (h, a, b);
+		}
+		a->next = pairs;
+		pairs = a;
+	}
+
+	/* Right to left: meld the pairs into one heap. */
+	while (pairs != NULL) {
+		struct heap_elem *p = pairs;
+
+		pairs = p->next;
+		p->next = NULL;
+		root = root != NULL ? meld (h, root, p) : p;
+	}
+	return root;
+}
+
+/* Unlinks E, which is not the root, from its parent's child
+   list, leaving it the root of its own subtree. */
+static void
+detach (struct heap_elem *e) {
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	e->next = e->prev = NULL;
+}
+
+/* Initializes heap H as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->elem_cnt = 0;
+	h->seq = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into heap H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	e->seq = h->seq++;
+	h->root = h->root != NULL ? meld (h, h->root, e) : e;
+	h->elem_cnt++;
+}
+
+/* Returns a maximum element of heap H, or a null pointer if H is
+   empty.  Among equal elements, the one pushed first. */
+struct heap_elem *
+heap_top (const struct heap *h) {
+	ASSERT (h != NULL);
+
+	return h->root;
+}
+
+/* Removes and returns heap_top(H).  H must not be empty. */
+struct heap_elem *
+heap_pop (struct heap *h) {
+	struct heap_elem *top;
+
+	ASSERT (h != NULL);
+	ASSERT (h->root != NULL);
+
+	top = h->root;
+	h->root = merge_pairs (h, top->child);
+	top->child = NULL;
+	h->elem_cnt--;
+	return top;
+}
+
+/* Removes E, which must be in heap H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) {
+	struct heap_elem *sub;
+
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	if (e == h->root) {
+		heap_pop (h);
+		return;
+	}
+
+	detach (e);
+	sub = merge_pairs (h, e->child);
+	e->child = NULL;
+	if (sub != NULL)
+		h->root = meld (h, h->root, sub);
+	h->elem_cnt--;
+}
+
+/* Restores heap order after E's key, E being in heap H, has
+   changed in either direction.  E keeps its push order. */
+void
+heap_update (struct heap *h, struct heap_elem *e) {
+	struct heap_elem *sub;
+
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	/* Cut E and its children apart and meld both back in. */
+	if (e == h->root)
+		h->root = NULL;
+	else
+		detach (e);
+	sub = merge_pairs (h, e->child);
+	e->child = NULL;
+	if (sub != NULL)
+		h->root = h->root != NULL ? meld (h, h->root, sub) : sub;
+	h->root = h->root != NULL ? meld (h, h->root, e) : e;
+}
+
+/* Returns the number of elements in heap H. */
+size_t
+heap_size (const struct heap *h) {
+	ASSERT (h != NULL);
+
+	return h->elem_cnt;
+}
+
+/* Returns true if heap H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h) {
+	ASSERT (h != NULL);
+
+	return h->root == NULL;
+}
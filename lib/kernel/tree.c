@@ -0,0 +1,205 @@
+#include "tree.h"
+#include "../debug.h"
+
+/* A treap is a binary search tree in which every element also
+   carries a random priority, and every element's priority is at
+   least that of its children.  The shape is then the one that
+   inserting the elements in decreasing priority order would give,
+   so its expected depth is O(log n) whatever the insertion order.
+
+   Insertion splits the subtree where the new element belongs by
+   priority into the keys below and above it; deletion replaces
+   an element by the merge of its two subtrees.  Both recurse
+   only as deep as the tree. */
+
+/* Returns a new pseudo-random priority for an element of T. */
+static unsigned
+next_priority (struct tree *t) {
+	/* xorshift32. */
+	unsigned x = t->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	t->seed = x;
+	return x;
+}
+
+/* Splits the subtree rooted at ROOT into the elements less than
+   KEY, stored in *LEFT, and those greater than it, stored in
+   *RIGHT.  No element may equal KEY. */
+static void
+split (const struct tree *t, struct tree_elem *root,
+		const struct tree_elem *key,
+		struct tree_elem **left, struct tree_elem **right) {
+	if (root == NULL)
+		*left = *right = NULL;
+	else if (t->less (root, key, t->aux)) {
+		split (t, root->right, key, &root->right, right);
+		*left = root;
+	} else {
+		split (t, root->left, key, left, &root->left);
+		*right = root;
+	}
+}
+
+/* Merges subtrees A and B, where every element of A is less
+   than every element of B, and returns the new root. */
+static struct tree_elem *
+merge (struct tree_elem *a, struct tree_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (a->priority >= b->priority) {
+		a->right = merge (a->right, b);
+		return a;
+	} else {
+		b->left = merge (a, b->left);
+		return b;
+	}
+}
+
+/* Inserts NEW into the subtree rooted at *ROOT. */
+static void
+insert (const struct tree *t, struct tree_elem **root,
+		struct tree_elem *new) {
+	if (*root == NULL || new->priority > (*root)->priority) {
+		split (t, *root, new, &new->left, &new->right);
+		*root = new;
+	} else if (t->less (new, *root, t->aux))
+		insert (t, &(*root)->left, new);
+	else
+		insert (t, &(*root)->right, new);
+}
+
+/* Initializes tree T to be empty, ordered by LESS given
+   auxiliary data AUX. */
+void
+tree_init (struct tree *t, tree_less_func *less, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (less != NULL);
+
+	t->root = NULL;
+	t->elem_cnt = 0;
+	t->seed = 2463534242u;
+	t->less = less;
+	t->aux = aux;
+}
+
+/* Inserts NEW into tree T and returns a null pointer, if no
+   equal element is already in the tree.
+   If an equal element is already in the tree, returns it
+   without inserting NEW. */
+struct tree_elem *
+tree_insert (struct tree *t, struct tree_elem *new) {
+	struct tree_elem *old = tree_find (t, new);
+
+	if (old != NULL)
+		return old;
+
+	new->left = new->right = NULL;
+	new->priority = next_priority (t);
+	insert (t, &t->root, new);
+	t->elem_cnt++;
+	return NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in tree T.
+   Returns a null pointer if no equal element existed in the
+   tree. */
+struct tree_elem *
+tree_delete (struct tree *t, struct tree_elem *e) {
+	struct tree_elem **link = &t->root;
+
+	while (*link != NULL) {
+		struct tree_elem *cur = *link;
+
+		if (t->less (e, cur, t->aux))
+			link = &cur->left;
+		else if (t->less (cur, e, t->aux))
+			link = &cur->right;
+		else {
+			*link = merge (cur->left, cur->right);
+			t->elem_cnt--;
+			return cur;
+		}
+	}
+	return NULL;
+}
+
+/* Finds and returns an element equal to E in tree T, or a null
+   pointer if no equal element exists in the tree. */
+struct tree_elem *
+tree_find (const struct tree *t, const struct tree_elem *e) {
+	struct tree_elem *cur = t->root;
+
+	while (cur != NULL) {
+		if (t->less (e, cur, t->aux))
+			cur = cur->left;
+		else if (t->less (cur, e, t->aux))
+			cur = cur->right;
+		else
+			return cur;
+	}
+	return NULL;
+}
+
+/* Returns the smallest element of tree T that is greater than or
+   equal to E, or a null pointer if there is none. */
+struct tree_elem *
+tree_ceil (const struct tree *t, const struct tree_elem *e) {
+	struct tree_elem *cur = t->root;
+	struct tree_elem *best = NULL;
+
+	while (cur != NULL) {
+		if (t->less (cur, e, t->aux))
+			cur = cur->right;
+		else {
+			best = cur;
+			cur = cur->left;
+		}
+	}
+	return best;
+}
+
+/* Returns the smallest element of tree T that is greater than E,
+   or a null pointer if there is none.  E need not be in T. */
+struct tree_elem *
+tree_next (const struct tree *t, const struct tree_elem *e) {
+	struct tree_elem *cur = t->root;
+	struct tree_elem *best = NULL;
+
+	while (cur != NULL) {
+		if (t->less (e, cur, t->aux)) {
+			best = cur;
+			cur = cur->left;
+		} else
+			cur = cur->right;
+	}
+	return best;
+}
+
+/* Returns the smallest element of tree T, or a null pointer if T
+   is empty. */
+struct tree_elem *
+tree_first (const struct tree *t) {
+	struct tree_elem *cur = t->root;
+
+	if (cur != NULL)
+		while (cur->left != NULL)
+			cur = cur->left;
+	return cur;
+}
+
+/* Returns the number of elements in T. */
+size_t
+tree_size (const struct tree *t) {
+	return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+tree_empty (const struct tree *t) {
+	return t->elem_cnt == 0;
+}
@@ -1,5 +1,40 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* Blocks of at least this many bytes are moved or set with the
+   `rep movsq' and `rep stosq' string instructions, which are the
+   fastest way to do so on x86-64 without SSE.  Shorter blocks are
+   done a word at a time in C, which avoids the startup cost of
+   the string instructions. */
+#define REP_MIN 64
+
+/* A 64-bit word that may sit at any address and alias any
+   object, for moving memory a word at a time. */
+typedef uint64_t word_t __attribute__ ((__may_alias__, __aligned__ (1)));
+
+/* Copies SIZE bytes from SRC to DST a word at a time, from the
+   lowest address up.  DST may overlap SRC only if it is below
+   it.  Leaves DST and SRC pointing past the bytes copied. */
+static void
+copy_forward (unsigned char *dst, const unsigned char *src, size_t size) {
+	if (size >= REP_MIN) {
+		/* Align DST, so that only the reads can be unaligned. */
+		size_t head = -(uintptr_t) dst & 7;
+		size_t words = (size - head) / 8;
+
+		size = (size - head) % 8;
+		asm volatile ("rep movsb; movq %3, %%rcx; rep movsq"
+				: "+D" (dst), "+S" (src), "+c" (head)
+				: "r" (words)
+				: "memory");
+	} else {
+		for (; size >= 8; size -= 8, dst += 8, src += 8)
+			*(word_t *) dst = *(const word_t *) src;
+	}
+	while (size-- > 0)
+		*dst++ = *src++;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,9 +46,7 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = *src++;
-
+	copy_forward (dst, src, size);
 	return dst_;
 }
 
@@ -27,17 +60,23 @@ memmove (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	if (dst < src) {
-		while (size-- > 0)
-			*dst++ = *src++;
+	if ((uintptr_t) dst - (uintptr_t) src >= size) {
+		/* DST is below SRC or past its end, so copying upward never
+		   overwrites a byte before it is read. */
+		copy_forward (dst, src, size);
 	} else {
 		dst += size;
 		src += size;
+		for (; size >= 8; size -= 8) {
+			dst -= 8;
+			src -= 8;
+			*(word_t *) dst = *(const word_t *) src;
+		}
 		while (size-- > 0)
 			*--dst = *--src;
 	}
 
-	return dst;
+	return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -52,6 +91,11 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip equal words; the byte loop then finds the difference
+	   within the first word that differs. */
+	for (; size >= 8; size -= 8, a += 8, b += 8)
+		if (*(const word_t *) a != *(const word_t *) b)
+			break;
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -257,9 +301,23 @@ strtok_r (char *s, const char *delimiters, char **save_ptr) {
 void *
 memset (void *dst_, int value, size_t size) {
 	unsigned char *dst = dst_;
+	uint64_t word = (unsigned char) value * 0x0101010101010101ULL;
 
 	ASSERT (dst != NULL || size == 0);
 
+	if (size >= REP_MIN) {
+		size_t head = -(uintptr_t) dst & 7;
+		size_t words = (size - head) / 8;
+
+		size = (size - head) % 8;
+		asm volatile ("rep stosb; movq %2, %%rcx; rep stosq"
+				: "+D" (dst), "+c" (head)
+				: "r" (words), "a" (word)
+				: "memory");
+	} else {
+		for (; size >= 8; size -= 8, dst += 8)
+			*(word_t *) dst = word;
+	}
 	while (size-- > 0)
 		*dst++ = value;
 
@@ -155,6 +155,11 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+void
+msync (void *addr) {
+	syscall1 (SYS_MSYNC, addr);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -0,0 +1,166 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks the word-at-a-time scanning and counting in bitmap.c
+   against simple bit-by-bit versions on large, fragmented
+   bitmaps, then times first-fit allocation from them.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Number of bits in each bitmap that we test. */
+#define BIT_CNT (4 * 1024 * 1024)
+
+/* Random scans to check per bitmap. */
+#define SCAN_CNT 32
+
+static void fragment (struct bitmap *, int density);
+static size_t slow_scan (const struct bitmap *, size_t start, size_t cnt,
+                         bool value);
+static size_t slow_count (const struct bitmap *, size_t start, size_t cnt,
+                          bool value);
+static void verify_scans (struct bitmap *);
+static void time_allocation (struct bitmap *, int density);
+
+/* Test the bitmap implementation. */
+void
+test (void) 
+{
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  int density;
+
+  ASSERT (b != NULL);
+  printf ("testing bitmaps of %d bits, percent set:", BIT_CNT);
+  for (density = 0; density <= 100; density += 25)
+    {
+      printf (" %d", density);
+      fragment (b, density);
+      verify_scans (b);
+    }
+  printf (" done\n");
+
+  for (density = 50; density <= 100; density += 25)
+    {
+      fragment (b, density);
+      time_allocation (b, density);
+    }
+
+  bitmap_destroy (b);
+  printf ("bitmap: PASS\n");
+}
+
+/* Sets about DENSITY percent of the bits in B, in runs of random
+   lengths, and clears the rest. */
+static void
+fragment (struct bitmap *b, int density) 
+{
+  size_t i = 0;
+
+  bitmap_set_all (b, false);
+  while (i < BIT_CNT)
+    {
+      size_t len = random_ulong () % 100 + 1;
+      bool value = (int) (random_ulong () % 100) < density;
+
+      if (len > BIT_CNT - i)
+        len = BIT_CNT - i;
+      bitmap_set_multiple (b, i, len, value);
+      i += len;
+    }
+}
+
+/* Returns the index of the first group of CNT bits in B at or
+   after START that are all set to VALUE, testing one bit at a
+   time. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t run = 0;
+  size_t i;
+
+  if (cnt == 0)
+    return start;
+  for (i = start; i < bitmap_size (b); i++)
+    if (bitmap_test (b, i) != value)
+      run = 0;
+    else if (++run == cnt)
+      return i + 1 - cnt;
+  return BITMAP_ERROR;
+}
+
+/* Returns the number of bits set to VALUE among the CNT bits in B
+   starting at START, testing one bit at a time. */
+static size_t
+slow_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t value_cnt = 0;
+  size_t i;
+
+  for (i = start; i < start + cnt; i++)
+    value_cnt += bitmap_test (b, i) == value;
+  return value_cnt;
+}
+
+/* Checks random scans and counts in B against the bit-by-bit
+   versions. */
+static void
+verify_scans (struct bitmap *b) 
+{
+  static const size_t cnts[] = {0, 1, 2, 7, 64, 65, 150, 1000};
+  int i;
+
+  for (i = 0; i < SCAN_CNT; i++)
+    {
+      size_t start = random_ulong () % (BIT_CNT + 1);
+      size_t cnt = cnts[random_ulong () % (sizeof cnts / sizeof *cnts)];
+      bool value = random_ulong () % 2;
+      size_t len = random_ulong () % 5000;
+
+      ASSERT (bitmap_scan (b, start, cnt, value)
+              == slow_scan (b, start, cnt, value));
+      if (len > BIT_CNT - start)
+        len = BIT_CNT - start;
+      ASSERT (bitmap_count (b, start, len, value)
+              == slow_count (b, start, len, value));
+      ASSERT (bitmap_contains (b, start, len, value)
+              == (slow_count (b, start, len, value) > 0));
+    }
+
+  /* First-fit allocation from the start, as the free map does it,
+     must agree with a fresh scan each time. */
+  for (i = 0; i < SCAN_CNT; i++)
+    {
+      size_t cnt = cnts[random_ulong () % (sizeof cnts / sizeof *cnts)];
+      size_t expected = slow_scan (b, 0, cnt, false);
+
+      ASSERT (bitmap_scan_and_flip (b, 0, cnt, false) == expected);
+      if (expected != BITMAP_ERROR && random_ulong () % 4 == 0)
+        bitmap_set_multiple (b, expected, cnt, false);
+    }
+}
+
+/* Allocates single bits from B, first fit, until it is full, and
+   prints the average time per allocation. */
+static void
+time_allocation (struct bitmap *b, int density) 
+{
+  size_t free_cnt = bitmap_count (b, 0, BIT_CNT, false);
+  uint64_t start = timer_now_ns ();
+  size_t i;
+
+  for (i = 0; i < free_cnt; i++)
+    ASSERT (bitmap_scan_and_flip (b, 0, 1, false) != BITMAP_ERROR);
+  ASSERT (bitmap_scan_and_flip (b, 0, 1, false) == BITMAP_ERROR);
+
+  printf ("%d%% set: %zu first-fit allocations, %llu ns each\n",
+          density, free_cnt,
+          free_cnt > 0 ? (timer_now_ns () - start) / free_cnt : 0);
+}
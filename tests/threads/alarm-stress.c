@@ -0,0 +1,125 @@
+/* Creates many threads that are all asleep at the same time,
+   with deadlines spread over several hundred ticks, and checks
+   that every one of them wakes up on or after its deadline and
+   in deadline order. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of sleepers.  Each one costs a page of kernel memory. */
+#define SLEEPER_CNT 500
+
+/* Sleep deadlines are spread over this many ticks. */
+#define SPREAD 600
+
+/* Information about the test. */
+struct sleep_test
+  {
+    int64_t start;              /* Current time at start of test. */
+    int *output_pos;            /* Current position in output buffer. */
+  };
+
+/* Information about an individual thread in the test. */
+struct sleep_thread
+  {
+    struct sleep_test *test;    /* Info shared between all threads. */
+    int id;                     /* Sleeper ID. */
+    int64_t deadline;           /* Tick to wake up on, relative to start. */
+    int64_t woke;               /* Tick it actually ran again. */
+  };
+
+static void sleeper (void *);
+
+void
+test_alarm_stress (void)
+{
+  struct sleep_test test;
+  struct sleep_thread *threads;
+  int *output, *op;
+  int64_t last;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep once each.", SLEEPER_CNT);
+  msg ("Thread I sleeps until 1 + (I * 37) %% %d ticks after start.", SPREAD);
+
+  /* Allocate memory. */
+  threads = malloc (sizeof *threads * SLEEPER_CNT);
+  output = malloc (sizeof *output * SLEEPER_CNT * 2);
+  if (threads == NULL || output == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  /* Initialize test. */
+  test.start = timer_ticks () + 200;
+  test.output_pos = output;
+
+  /* Start threads.  37 is coprime to SPREAD, so every deadline is
+     distinct. */
+  for (i = 0; i < SLEEPER_CNT; i++)
+    {
+      struct sleep_thread *t = threads + i;
+      char name[16];
+
+      t->test = &test;
+      t->id = i;
+      t->deadline = 1 + (i * 37) % SPREAD;
+      t->woke = -1;
+
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, t) == TID_ERROR)
+        fail ("couldn't create thread %d", i);
+    }
+
+  /* Wait long enough for all the threads to finish. */
+  timer_sleep (test.start + SPREAD + 100 - timer_ticks ());
+
+  if (test.output_pos - output != SLEEPER_CNT)
+    fail ("%d threads woke up instead of %d",
+          (int) (test.output_pos - output), SLEEPER_CNT);
+
+  last = 0;
+  for (op = output; op < test.output_pos; op++)
+    {
+      struct sleep_thread *t;
+
+      ASSERT (*op >= 0 && *op < SLEEPER_CNT);
+      t = threads + *op;
+
+      if (t->woke < t->deadline)
+        fail ("thread %d woke up at tick %lld, before its deadline %lld",
+              t->id, t->woke, t->deadline);
+      if (t->deadline <= last)
+        fail ("thread %d woke up out of order (%lld after %lld)",
+              t->id, t->deadline, last);
+      last = t->deadline;
+    }
+  msg ("All %d threads woke up in deadline order.", SLEEPER_CNT);
+
+  free (output);
+  free (threads);
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *t_)
+{
+  struct sleep_thread *t = t_;
+  struct sleep_test *test = t->test;
+  enum intr_level old_level;
+
+  timer_sleep (test->start + t->deadline - timer_ticks ());
+
+  /* Record without taking a lock, so that a sleeper blocking on
+     the lock cannot be overtaken by the next one to wake up. */
+  old_level = intr_disable ();
+  t->woke = timer_ticks () - test->start;
+  *test->output_pos++ = t->id;
+  intr_set_level (old_level);
+}
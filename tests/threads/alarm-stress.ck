@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-stress) begin
+(alarm-stress) Creating 500 threads to sleep once each.
+(alarm-stress) Thread I sleeps until 1 + (I * 37) % 600 ticks after start.
+(alarm-stress) All 500 threads woke up in deadline order.
+(alarm-stress) end
+EOF
+pass;
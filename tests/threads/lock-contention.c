@@ -0,0 +1,153 @@
+/* Measures the cost of locks and reader-writer locks with and
+   without contention, and checks that they still provide mutual
+   exclusion.
+
+   Contention is forced by yielding inside the critical section
+   now and then, so that other threads run into a held lock and
+   have to sleep on it.  The reader-writer phase keeps two
+   counters that writers always update together; a reader that
+   sees them differ has overlapped a writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Uncontended acquire/release pairs to time. */
+#define SOLO_ITERS 10000
+
+/* Threads and per-thread iterations for the contended phases. */
+#define THREAD_CNT 8
+#define ITERS 2000
+
+/* A thread yields inside every YIELD_EVERY'th critical section;
+   one in WRITE_EVERY reader-writer iterations writes. */
+#define YIELD_EVERY 16
+#define WRITE_EVERY 10
+
+static struct lock lock;
+static struct rwlock rw;
+static struct semaphore done;
+static int counter;
+static int rw_a, rw_b;
+static int torn_reads;
+
+static void lock_worker (void *);
+static void rw_worker (void *);
+static uint64_t run_workers (thread_func *);
+
+void
+test_lock_contention (void)
+{
+  uint64_t start, solo_ns, lock_ns, rw_ns;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+  rw_init (&rw);
+  sema_init (&done, 0);
+
+  start = timer_now_ns ();
+  for (i = 0; i < SOLO_ITERS; i++)
+    {
+      lock_acquire (&lock);
+      lock_release (&lock);
+    }
+  solo_ns = timer_now_ns () - start;
+
+  counter = 0;
+  lock_ns = run_workers (lock_worker);
+  if (counter != THREAD_CNT * ITERS)
+    fail ("lock: counter is %d, expected %d", counter, THREAD_CNT * ITERS);
+
+  rw_a = rw_b = 0;
+  torn_reads = 0;
+  rw_ns = run_workers (rw_worker);
+  if (torn_reads != 0)
+    fail ("rwlock: %d reads overlapped a writer", torn_reads);
+  if (rw_a != THREAD_CNT * (ITERS / WRITE_EVERY))
+    fail ("rwlock: %d writes, expected %d",
+          rw_a, THREAD_CNT * (ITERS / WRITE_EVERY));
+
+  msg ("uncontended lock: %llu ns per acquire/release",
+       solo_ns / SOLO_ITERS);
+  msg ("contended lock, %d threads: %llu ns per acquire/release",
+       THREAD_CNT, lock_ns / (THREAD_CNT * ITERS));
+  msg ("rwlock, %d threads, 1 write in %d: %llu ns per acquire/release",
+       THREAD_CNT, WRITE_EVERY, rw_ns / (THREAD_CNT * ITERS));
+  pass ();
+}
+
+/* Runs THREAD_CNT copies of FUNC and returns the elapsed time in
+   nanoseconds once all of them have finished. */
+static uint64_t
+run_workers (thread_func *func)
+{
+  uint64_t start = timer_now_ns ();
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "worker %d", i);
+      thread_create (name, PRI_DEFAULT, func, NULL);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  return timer_now_ns () - start;
+}
+
+static void
+lock_worker (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERS; i++)
+    {
+      int old;
+
+      lock_acquire (&lock);
+      old = counter;
+      if (i % YIELD_EVERY == 0)
+        thread_yield ();
+      counter = old + 1;
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
+
+static void
+rw_worker (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERS; i++)
+    {
+      if (i % WRITE_EVERY == 0)
+        {
+          rw_write_acquire (&rw);
+          rw_a++;
+          if (i % YIELD_EVERY == 0)
+            thread_yield ();
+          rw_b++;
+          rw_write_release (&rw);
+        }
+      else
+        {
+          int a;
+
+          rw_read_acquire (&rw);
+          a = rw_a;
+          if (i % YIELD_EVERY == 0)
+            thread_yield ();
+          if (a != rw_b)
+            torn_reads++;
+          rw_read_release (&rw);
+        }
+    }
+  sema_up (&done);
+}
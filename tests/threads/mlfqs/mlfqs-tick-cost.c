@@ -0,0 +1,106 @@
+/* Measures how much CPU time the timer interrupt takes away from
+   a spinning thread while 10, 100, and 1000 other threads exist
+   but are blocked, and checks that it does not grow with the
+   thread count.
+
+   The spinning thread reads timer_now_ns() in a tight loop.  Any
+   gap between two consecutive reads that is longer than GAP_NS is
+   time spent somewhere else, which for a lone
+   ready thread means the timer interrupt.  The 90th percentile of
+   those gaps is reported, which catches work done on every 4th
+   tick but not the once-per-second deferred recent_cpu decay. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Gaps shorter than this, in nanoseconds, are ordinary loop
+   iterations. */
+#define GAP_NS 1000
+
+/* Number of gaps to record for each thread count. */
+#define GAP_CNT 200
+
+static uint64_t measure (int thread_cnt);
+
+void
+test_mlfqs_tick_cost (void)
+{
+  uint64_t cost_10, cost_100, cost_1000;
+
+  ASSERT (thread_mlfqs);
+
+  cost_10 = measure (10);
+  cost_100 = measure (100);
+  cost_1000 = measure (1000);
+
+  msg ("10 threads: %llu ns per tick", cost_10);
+  msg ("100 threads: %llu ns per tick", cost_100);
+  msg ("1000 threads: %llu ns per tick", cost_1000);
+
+  if (cost_1000 > cost_10 * 3)
+    fail ("tick cost grew from %llu to %llu ns", cost_10, cost_1000);
+  pass ();
+}
+
+static void
+blocker (void *release_)
+{
+  struct semaphore *release = release_;
+  sema_down (release);
+}
+
+/* Creates THREAD_CNT blocked threads, spins until GAP_CNT gaps
+   have been seen, and returns the 90th percentile gap. */
+static uint64_t
+measure (int thread_cnt)
+{
+  struct semaphore release;
+  uint64_t *gaps, prev, now, result;
+  int i, j, n;
+
+  gaps = malloc (sizeof *gaps * GAP_CNT);
+  if (gaps == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  sema_init (&release, 0);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "blk %d", i);
+      if (thread_create (name, PRI_DEFAULT, blocker, &release) == TID_ERROR)
+        fail ("couldn't create thread %d", i);
+    }
+
+  /* Let every blocker run up to its sema_down(). */
+  timer_sleep (TIMER_FREQ / 10);
+
+  prev = timer_now_ns ();
+  for (n = 0; n < GAP_CNT; prev = now)
+    {
+      now = timer_now_ns ();
+      if (now - prev > GAP_NS)
+        gaps[n++] = now - prev;
+    }
+
+  /* Insertion sort: GAP_CNT is small. */
+  for (i = 1; i < GAP_CNT; i++)
+    for (j = i; j > 0 && gaps[j - 1] > gaps[j]; j--)
+      {
+        uint64_t tmp = gaps[j];
+        gaps[j] = gaps[j - 1];
+        gaps[j - 1] = tmp;
+      }
+  result = gaps[GAP_CNT * 9 / 10];
+
+  for (i = 0; i < thread_cnt; i++)
+    sema_up (&release);
+  timer_sleep (TIMER_FREQ / 10);
+
+  free (gaps);
+  return result;
+}
@@ -0,0 +1,96 @@
+/* Measures what sema_up() costs with 10 and with 1000 threads
+   waiting on the semaphore, and checks that the waiters still
+   wake up highest priority first and, within a priority, in the
+   order they started waiting.
+
+   The waiters are created at priorities above ours so each one
+   blocks on the semaphore right away.  We then raise ourselves to
+   PRI_MAX, so that the timed sema_up() calls only pick and
+   unblock waiters without switching to them. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Maximum number of waiters.  Each one costs a page of kernel
+   memory. */
+#define WAITER_CNT 1000
+
+static struct semaphore sema;
+static int priorities[WAITER_CNT];
+static int order[WAITER_CNT];
+static int order_cnt;
+
+static void waiter (void *);
+static uint64_t measure (int waiter_cnt);
+
+void
+test_priority_sema_wakeup (void)
+{
+  uint64_t ns_10, ns_1000;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  ns_10 = measure (10);
+  ns_1000 = measure (WAITER_CNT);
+
+  msg ("10 waiters: %llu ns per wakeup", ns_10);
+  msg ("%d waiters: %llu ns per wakeup", WAITER_CNT, ns_1000);
+  pass ();
+}
+
+/* Blocks WAITER_CNT threads on a semaphore, wakes them all, and
+   returns the average cost of one sema_up() in nanoseconds. */
+static uint64_t
+measure (int waiter_cnt)
+{
+  uint64_t start, elapsed;
+  int i;
+
+  sema_init (&sema, 0);
+  order_cnt = 0;
+  for (i = 0; i < waiter_cnt; i++)
+    {
+      char name[16];
+
+      priorities[i] = PRI_DEFAULT + 1 + (i * 7) % (PRI_MAX - PRI_DEFAULT - 1);
+      snprintf (name, sizeof name, "waiter %d", i);
+      thread_create (name, priorities[i], waiter, (void *) (intptr_t) i);
+    }
+
+  thread_set_priority (PRI_MAX);
+  start = timer_now_ns ();
+  for (i = 0; i < waiter_cnt; i++)
+    sema_up (&sema);
+  elapsed = timer_now_ns () - start;
+
+  /* Let the waiters run; they record the order they woke in. */
+  thread_set_priority (PRI_MIN);
+  thread_set_priority (PRI_DEFAULT);
+
+  if (order_cnt != waiter_cnt)
+    fail ("%d of %d waiters woke up", order_cnt, waiter_cnt);
+  for (i = 1; i < waiter_cnt; i++)
+    {
+      int a = order[i - 1], b = order[i];
+
+      if (priorities[b] > priorities[a]
+          || (priorities[b] == priorities[a] && b < a))
+        fail ("waiter %d (priority %d) woke after waiter %d (priority %d)",
+              b, priorities[b], a, priorities[a]);
+    }
+  return elapsed / waiter_cnt;
+}
+
+static void
+waiter (void *id_)
+{
+  int id = (intptr_t) id_;
+
+  sema_down (&sema);
+  order[order_cnt++] = id;
+}
@@ -0,0 +1,200 @@
+/* Checks memcpy, memmove, memset and memcmp against plain byte
+   loops at every small size and alignment, then measures their
+   throughput against the same byte loops for blocks of 16 bytes
+   to 1 MB. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* Largest block to time, and about how many bytes to move in
+   total at each size. */
+#define MAX_SIZE (1024 * 1024)
+#define BYTES_PER_SIZE (4 * 1024 * 1024)
+
+/* Blocks up to CHECK_SIZE bytes, at every offset below
+   CHECK_ALIGN, are checked against the byte loops. */
+#define CHECK_SIZE 160
+#define CHECK_ALIGN 8
+
+/* Pages per buffer: MAX_SIZE bytes plus room for misalignment. */
+#define BUF_PAGES (MAX_SIZE / PGSIZE + 1)
+
+static unsigned char *a, *b, *c;
+
+static void check (void);
+static uint64_t time_copy (void *(*) (void *, const void *, size_t),
+                           size_t);
+static uint64_t time_set (void *(*) (void *, int, size_t), size_t);
+static void *byte_memcpy (void *, const void *, size_t);
+static void *byte_memset (void *, int, size_t);
+static uint64_t mb_per_s (uint64_t ns);
+
+void
+test_string_bench (void)
+{
+  size_t size;
+
+  a = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+  b = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+  c = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+
+  check ();
+
+  for (size = 16; size <= MAX_SIZE; size *= 4)
+    {
+      uint64_t cpy = time_copy (memcpy, size);
+      uint64_t byte_cpy = time_copy (byte_memcpy, size);
+      uint64_t set = time_set (memset, size);
+      uint64_t byte_set = time_set (byte_memset, size);
+
+      msg ("%7zu bytes: memcpy %llu MB/s (bytes: %llu MB/s), "
+           "memset %llu MB/s (bytes: %llu MB/s)",
+           size, mb_per_s (cpy), mb_per_s (byte_cpy),
+           mb_per_s (set), mb_per_s (byte_set));
+    }
+
+  palloc_free_multiple (a, BUF_PAGES);
+  palloc_free_multiple (b, BUF_PAGES);
+  palloc_free_multiple (c, BUF_PAGES);
+  pass ();
+}
+
+/* Fills the first SIZE bytes of P with a pattern that depends on
+   SEED. */
+static void
+fill (unsigned char *p, size_t size, unsigned seed)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    p[i] = (i * 7 + seed) ^ (i >> 8);
+}
+
+/* Compares every block of up to CHECK_SIZE bytes, at every pair
+   of alignments, with the result of the byte loops. */
+static void
+check (void)
+{
+  size_t span = CHECK_SIZE + 2 * CHECK_ALIGN;
+  size_t size, src_ofs, dst_ofs;
+
+  for (size = 0; size <= CHECK_SIZE; size++)
+    for (src_ofs = 0; src_ofs < CHECK_ALIGN; src_ofs++)
+      for (dst_ofs = 0; dst_ofs < CHECK_ALIGN; dst_ofs++)
+        {
+          size_t i;
+
+          /* memcpy. */
+          fill (a, span, size);
+          fill (b, span, 3);
+          memcpy (c, b, span);
+          if (memcpy (b + dst_ofs, a + src_ofs, size) != b + dst_ofs)
+            fail ("memcpy returned the wrong pointer");
+          byte_memcpy (c + dst_ofs, a + src_ofs, size);
+          for (i = 0; i < span; i++)
+            if (b[i] != c[i])
+              fail ("memcpy of %zu bytes from +%zu to +%zu is wrong",
+                    size, src_ofs, dst_ofs);
+
+          /* memmove, between overlapping blocks in both directions. */
+          fill (b, span, 5);
+          memcpy (c, b, span);
+          if (memmove (b + dst_ofs, b + src_ofs, size) != b + dst_ofs)
+            fail ("memmove returned the wrong pointer");
+          if (dst_ofs < src_ofs)
+            for (i = 0; i < size; i++)
+              c[dst_ofs + i] = c[src_ofs + i];
+          else
+            for (i = size; i-- > 0; )
+              c[dst_ofs + i] = c[src_ofs + i];
+          for (i = 0; i < span; i++)
+            if (b[i] != c[i])
+              fail ("memmove of %zu bytes from +%zu to +%zu is wrong",
+                    size, src_ofs, dst_ofs);
+
+          /* memset. */
+          fill (b, span, 9);
+          memcpy (c, b, span);
+          memset (b + dst_ofs, 0x100 + size, size);
+          byte_memset (c + dst_ofs, 0x100 + size, size);
+          for (i = 0; i < span; i++)
+            if (b[i] != c[i])
+              fail ("memset of %zu bytes at +%zu is wrong", size, dst_ofs);
+
+          /* memcmp, with no difference and with one at a spread of
+             positions. */
+          fill (a, span, 11);
+          memcpy (b, a, span);
+          if (memcmp (a + src_ofs, b + src_ofs, size) != 0)
+            fail ("memcmp of %zu equal bytes is nonzero", size);
+          for (i = 0; i < size; i += size / 8 + 1)
+            {
+              b[src_ofs + i]++;
+              if (memcmp (a + src_ofs, b + src_ofs, size)
+                  != (a[src_ofs + i] > b[src_ofs + i] ? 1 : -1))
+                fail ("memcmp of %zu bytes differing at %zu is wrong",
+                      size, i);
+              b[src_ofs + i]--;
+            }
+        }
+}
+
+/* Returns the nanoseconds taken by FUNC to copy BYTES_PER_SIZE
+   bytes in blocks of SIZE bytes. */
+static uint64_t
+time_copy (void *(*func) (void *, const void *, size_t), size_t size)
+{
+  size_t i, cnt = BYTES_PER_SIZE / size;
+  uint64_t start = timer_now_ns ();
+
+  for (i = 0; i < cnt; i++)
+    func (b, a, size);
+  return timer_now_ns () - start;
+}
+
+/* Returns the nanoseconds taken by FUNC to set BYTES_PER_SIZE
+   bytes in blocks of SIZE bytes. */
+static uint64_t
+time_set (void *(*func) (void *, int, size_t), size_t size)
+{
+  size_t i, cnt = BYTES_PER_SIZE / size;
+  uint64_t start = timer_now_ns ();
+
+  for (i = 0; i < cnt; i++)
+    func (b, i, size);
+  return timer_now_ns () - start;
+}
+
+/* Returns the throughput of moving BYTES_PER_SIZE bytes in NS
+   nanoseconds, in MB/s. */
+static uint64_t
+mb_per_s (uint64_t ns)
+{
+  return ns > 0 ? (uint64_t) BYTES_PER_SIZE * 1000 / ns : 0;
+}
+
+/* The byte loops that lib/string.c used to have. */
+static void *
+byte_memcpy (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+  return dst_;
+}
+
+static void *
+byte_memset (void *dst_, int value, size_t size)
+{
+  unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+  return dst_;
+}
@@ -7,6 +7,7 @@
 #include <string.h>
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -19,15 +20,24 @@
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
+   malloc() returns a null pointer).  Blocks are carved off the
+   new arena one at a time, in address order, as they are needed,
+   so setting up an arena costs nothing per block.
 
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
+   The descriptor's free list is protected by a lock.  To keep
+   most calls away from it, each thread keeps a small "magazine"
+   of free blocks per descriptor in its struct thread.  malloc()
+   takes a block from the magazine and free() puts one back;
+   only an empty magazine is refilled, and a full one drained,
+   under the lock, half a magazine at a time.  A thread's
+   magazines are drained when it exits.  Blocks in a magazine
+   count as in use as far as their arena is concerned.
+
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
@@ -38,10 +48,17 @@
 struct desc {
 	size_t block_size;          /* Size of each element in bytes. */
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
+	size_t magazine_size;       /* Capacity of a thread's magazine. */
 	struct list free_list;      /* List of free blocks. */
+	struct arena *bump;         /* Arena with never-used blocks, if any. */
 	struct lock lock;           /* Lock. */
 };
 
+/* A magazine holds at most this many blocks, or this many bytes'
+   worth of blocks, whichever is smaller. */
+#define MAGAZINE_MAX 16
+#define MAGAZINE_BYTES 1024
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -50,11 +67,15 @@ struct arena {
 	unsigned magic;             /* Always set to ARENA_MAGIC. */
 	struct desc *desc;          /* Owning descriptor, null for big block. */
 	size_t free_cnt;            /* Free blocks; pages in big block. */
+	size_t bump_cnt;            /* Blocks handed out at least once. */
 };
 
 /* Free block. */
 struct block {
-	struct list_elem free_elem; /* Free list element. */
+	union {
+		struct list_elem free_elem; /* Free list element. */
+		struct block *next;         /* Next block in a magazine. */
+	};
 };
 
 /* Our set of descriptors. */
@@ -63,6 +84,9 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static bool magazine_refill (struct desc *, struct malloc_magazine *);
+static void magazine_drain (struct desc *, struct malloc_magazine *,
+		size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -74,9 +98,36 @@ malloc_init (void) {
 		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+		d->magazine_size = MAGAZINE_BYTES / block_size;
+		if (d->magazine_size > MAGAZINE_MAX)
+			d->magazine_size = MAGAZINE_MAX;
+		if (d->magazine_size < 1)
+			d->magazine_size = 1;
 		list_init (&d->free_list);
+		d->bump = NULL;
 		lock_init (&d->lock);
 	}
+	ASSERT (desc_cnt == MALLOC_CLASS_CNT);
+}
+
+/* Returns the running thread's cache of free blocks from D. */
+static struct malloc_magazine *
+magazine (struct desc *d) {
+	return &thread_current ()->malloc_mags[d - descs];
+}
+
+/* Returns every block in the running thread's magazines to its
+   descriptor.  Called by thread_exit(), after which the thread
+   must not allocate or free blocks. */
+void
+malloc_thread_exit (void) {
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++) {
+		struct malloc_magazine *m = magazine (d);
+		if (m->cnt > 0)
+			magazine_drain (d, m, m->cnt);
+	}
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -84,6 +135,7 @@ malloc_init (void) {
 void *
 malloc (size_t size) {
 	struct desc *d;
+	struct malloc_magazine *m;
 	struct block *b;
 	struct arena *a;
 
@@ -112,34 +164,13 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
-
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
-
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
-			return NULL;
-		}
-
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
-		}
-	}
-
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
-	lock_release (&d->lock);
+	/* Take a block from our magazine, refilling it if empty. */
+	m = magazine (d);
+	if (m->cnt == 0 && !magazine_refill (d, m))
+		return NULL;
+	b = m->head;
+	m->head = b->next;
+	m->cnt--;
 	return b;
 }
 
@@ -213,24 +244,13 @@ free (void *p) {
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
-			}
-
-			lock_release (&d->lock);
+			/* Put it in our magazine, making room if it is full. */
+			struct malloc_magazine *m = magazine (d);
+			if (m->cnt >= d->magazine_size)
+				magazine_drain (d, m, (d->magazine_size + 1) / 2);
+			b->next = m->head;
+			m->head = b;
+			m->cnt++;
 		} else {
 			/* It's a big block.  Free its pages. */
 			palloc_free_multiple (a, a->free_cnt);
@@ -239,6 +259,105 @@ free (void *p) {
 	}
 }
 
+/* Removes a free block from D and returns it, or returns a null
+   pointer if memory is not available.  D's lock must be held. */
+static struct block *
+desc_get_block (struct desc *d) {
+	struct block *b;
+	struct arena *a;
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	if (!list_empty (&d->free_list)) {
+		b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+		a = block_to_arena (b);
+	} else {
+		/* Carve the next never-used block off the bump arena,
+		   starting a new arena if there is none. */
+		if (d->bump == NULL) {
+			a = palloc_get_page (0);
+			if (a == NULL)
+				return NULL;
+			a->magic = ARENA_MAGIC;
+			a->desc = d;
+			a->free_cnt = d->blocks_per_arena;
+			a->bump_cnt = 0;
+			d->bump = a;
+		}
+		a = d->bump;
+		b = arena_to_block (a, a->bump_cnt++);
+		if (a->bump_cnt == d->blocks_per_arena)
+			d->bump = NULL;
+	}
+	a->free_cnt--;
+	return b;
+}
+
+/* Returns block B to D.  D's lock must be held. */
+static void
+desc_put_block (struct desc *d, struct block *b) {
+	struct arena *a = block_to_arena (b);
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* Add block to free list. */
+	list_push_front (&d->free_list, &b->free_elem);
+
+	/* If the arena is now entirely unused, free it. */
+	if (++a->free_cnt >= d->blocks_per_arena) {
+		size_t i;
+
+		ASSERT (a->free_cnt == d->blocks_per_arena);
+		for (i = 0; i < a->bump_cnt; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_remove (&b->free_elem);
+		}
+		if (d->bump == a || d->bump == NULL) {
+			/* Keep it as the bump arena, starting over. */
+			a->bump_cnt = 0;
+			d->bump = a;
+		} else
+			palloc_free_page (a);
+	}
+}
+
+/* Moves up to half of D's magazine capacity from D into empty
+   magazine M.  Returns false if not even one block could be
+   had. */
+static bool
+magazine_refill (struct desc *d, struct malloc_magazine *m) {
+	size_t want = (d->magazine_size + 1) / 2;
+
+	ASSERT (m->cnt == 0);
+
+	lock_acquire (&d->lock);
+	while (m->cnt < want) {
+		struct block *b = desc_get_block (d);
+		if (b == NULL)
+			break;
+		b->next = m->head;
+		m->head = b;
+		m->cnt++;
+	}
+	lock_release (&d->lock);
+	return m->cnt > 0;
+}
+
+/* Moves CNT blocks from magazine M back to D. */
+static void
+magazine_drain (struct desc *d, struct malloc_magazine *m, size_t cnt) {
+	ASSERT (cnt <= m->cnt);
+
+	lock_acquire (&d->lock);
+	while (cnt-- > 0) {
+		struct block *b = m->head;
+		m->head = b->next;
+		m->cnt--;
+		desc_put_block (d, b);
+	}
+	lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
@@ -1,13 +1,96 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdio.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers.
+
+   If the CPU supports PCIDs, every TLB entry is tagged with the
+   PCID that was in CR3 when it was loaded, and switching CR3 need
+   not flush the entries of other PCIDs, so a process that runs
+   again finds its translations still cached.
+
+   Each pml4 gets the PCID that its physical address hashes to,
+   from 1 to PCID_CNT - 1; the base pml4 has PCID 0.  PCID_OWNER
+   records which pml4 last used each PCID.  A pml4 that finds its
+   PCID taken over by another, or not yet its own, flushes the
+   PCID's entries as it loads CR3, so the TLB never holds entries
+   of one pml4 tagged with the PCID of another.
+
+   A change to the page table of the running process is flushed
+   from the TLB with INVLPG, as without PCIDs.  A change to that
+   of another process, as eviction and fork make, is flushed with
+   INVPCID if the CPU has it, and otherwise by marking the PCID
+   stale, so that the next CR3 load for it flushes it whole. */
+#define PCID_CNT 4096                   /* PCIDs that fit in CR3. */
+#define CR3_NOFLUSH (1ULL << 63)        /* Keep TLB entries on load. */
+#define CR4_PCIDE 0x20000               /* Enable PCIDs. */
+#define CPUID_PCID 0x20000              /* CPUID 1, ECX: has PCIDs. */
+#define CPUID_INVPCID 0x400             /* CPUID 7, EBX: has INVPCID. */
+
+static bool pcid_enabled;               /* Using PCIDs? */
+static bool invpcid_enabled;            /* Can INVPCID? */
+static uint64_t *pcid_owner[PCID_CNT];  /* Last pml4 to use each PCID. */
+
+/* Page tables set aside for splitting huge pages: one for each
+   huge page mapped, so that pml4_demote_page() never has to
+   allocate memory.  Each is linked to the next through its first
+   word. */
+static void *pt_reserve;
+
+static void pt_reserve_push (void *pt);
+static void *pt_reserve_pop (void);
+static bool pcid_stale[PCID_CNT];       /* Must flush on next use? */
+
+/* PCID statistics. */
+static unsigned long long pcid_keep_cnt;  /* Switches keeping the TLB. */
+static unsigned long long pcid_flush_cnt; /* Switches flushing a PCID. */
+
+/* Returns the PCID of PML4. */
+static uint64_t
+pml4_pcid (uint64_t *pml4) {
+	return 1 + pg_no (vtop (pml4)) % (PCID_CNT - 1);
+}
+
+/* Returns true if PML4 is the page table the CPU is using. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Flushes the TLB entry for user virtual page VA in PML4. */
+static void
+tlb_flush_page (uint64_t *pml4, const void *va) {
+	uint64_t pcid;
+
+	if (pml4_is_active (pml4))
+		invlpg ((uint64_t) va);
+	else if (pcid_enabled && pcid_owner[pcid = pml4_pcid (pml4)] == pml4) {
+		if (invpcid_enabled)
+			invpcid (pcid, (uint64_t) va);
+		else
+			pcid_stale[pcid] = true;
+	}
+}
+
+/* Flushes every TLB entry for user pages in PML4. */
+static void
+tlb_flush (uint64_t *pml4) {
+	uint64_t pcid;
+
+	if (pml4_is_active (pml4))
+		lcr3 (rcr3 ());
+	else if (pcid_enabled && pcid_owner[pcid = pml4_pcid (pml4)] == pml4)
+		pcid_stale[pcid] = true;
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -23,6 +106,10 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		/* A huge page has no page table; its PDE stands in for the
+		   PTE, with the same flags in the same places. */
+		if (pdp[idx] & PTE_PS)
+			return &pdp[idx];
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
@@ -60,7 +147,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a huge page, its page directory entry is
+ * returned instead. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -88,6 +177,31 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the table that ENTRY points to, creating an empty one
+ * if there is none and CREATE is true, or a null pointer. */
+static uint64_t *
+next_level (uint64_t *entry, bool create) {
+	if (!(*entry & PTE_P)) {
+		uint64_t *new_page;
+
+		if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		*entry = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (*entry));
+}
+
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4, creating the upper levels if CREATE, or a
+ * null pointer. */
+static uint64_t *
+pde_walk (uint64_t *pml4, const uint64_t va, bool create) {
+	uint64_t *pdp = next_level (&pml4[PML4 (va)], create);
+	uint64_t *pgdir = pdp != NULL ? next_level (&pdp[PDPE (va)], create)
+		: NULL;
+	return pgdir != NULL ? &pgdir[PDX (va)] : NULL;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,10 +236,17 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+		if (((uint64_t) pte) & PTE_P) {
+			if (pdp[i] & PTE_PS) {
+				void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+									 ((uint64_t) pdp_index << PDPESHIFT) |
+									 ((uint64_t) i << PDXSHIFT));
+				if (!func (&pdp[i], va, aux))
+					return false;
+			} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
+		}
 	}
 	return true;
 }
@@ -169,8 +290,13 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+		if (((uint64_t) pte) & PTE_P) {
+			if (pdp[i] & PTE_PS) {
+				palloc_free_multiple ((void *) PTE_ADDR (pte), HPG_PAGES);
+				palloc_free_page (pt_reserve_pop ());
+			} else
+				pt_destroy ((uint64_t *) PTE_ADDR (pte));
+		}
 	}
 	palloc_free_page ((void *) pdp);
 }
@@ -196,14 +322,76 @@ pml4_destroy (uint64_t *pml4) {
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+
+	/* A new pml4 in the same page must not inherit the TLB. */
+	if (pcid_enabled && pcid_owner[pml4_pcid (pml4)] == pml4)
+		pcid_owner[pml4_pcid (pml4)] = NULL;
 	palloc_free_page ((void *) pml4);
 }
 
+/* Starts tagging TLB entries with PCIDs, if the CPU can.  Must be
+ * called with the base pml4 active, since CR3 must hold PCID 0
+ * when PCIDs are turned on. */
+void
+pml4_init_pcid (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	ASSERT (rcr3 () == vtop (base_pml4));
+
+	cpuid (1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & CPUID_PCID))
+		return;
+	cpuid (0, 0, &eax, &ebx, &ecx, &edx);
+	if (eax >= 7) {
+		cpuid (7, 0, &eax, &ebx, &ecx, &edx);
+		invpcid_enabled = (ebx & CPUID_INVPCID) != 0;
+	}
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  With PCIDs, the TLB entries of PML4 are kept from
+ * the last time it was active, unless something since made them
+ * stale. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	uint64_t pcid;
+
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4 ? pml4 : base_pml4));
+		return;
+	}
+	if (pml4 == NULL) {
+		/* The kernel's mappings never change. */
+		lcr3 (vtop (base_pml4) | CR3_NOFLUSH);
+		return;
+	}
+
+	old_level = intr_disable ();
+	pcid = pml4_pcid (pml4);
+	if (pcid_owner[pcid] == pml4 && !pcid_stale[pcid]) {
+		lcr3 (vtop (pml4) | pcid | CR3_NOFLUSH);
+		pcid_keep_cnt++;
+	} else {
+		pcid_owner[pcid] = pml4;
+		pcid_stale[pcid] = false;
+		lcr3 (vtop (pml4) | pcid);
+		pcid_flush_cnt++;
+	}
+	intr_set_level (old_level);
+}
+
+/* Prints TLB statistics. */
+void
+pml4_print_stats (void) {
+	if (pcid_enabled)
+		printf ("TLB: PCIDs on%s, %llu switches kept entries, "
+				"%llu flushed\n", invpcid_enabled ? " with INVPCID" : "",
+				pcid_keep_cnt, pcid_flush_cnt);
+	else
+		printf ("TLB: PCIDs off\n");
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,8 +404,12 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (PTE_ADDR (*pte))
+				+ ((uint64_t) uaddr & (HPGSIZE - 1));
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -238,15 +430,104 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		ASSERT (!(*pte & PTE_PS));
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	}
 	return pte != NULL;
 }
 
+/* Maps the 2 MB of user virtual memory at UPAGE in PML4 to the
+ * HPG_PAGES physically contiguous pages at kernel virtual address
+ * KPAGE, as one huge page.  Both must be aligned to HPGSIZE.
+ * Any pages mapped in the range are unmapped, but the frames they
+ * were mapped to are left to the caller.  Their page table is kept
+ * in reserve for splitting the huge page up again.  If RW is
+ * true, the huge page is read/write; otherwise it is read-only.
+ * Returns true if successful, false if memory allocation failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde, old;
+
+	ASSERT (((uint64_t) upage & (HPGSIZE - 1)) == 0);
+	ASSERT ((vtop (kpage) & (HPGSIZE - 1)) == 0);
+	ASSERT (is_user_vaddr ((uint8_t *) upage + HPGSIZE - 1));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pde_walk (pml4, (uint64_t) upage, true);
+	if (pde == NULL)
+		return false;
+	old = *pde;
+	ASSERT (!(old & PTE_PS));
+	if (old & PTE_P)
+		pt_reserve_push (ptov (PTE_ADDR (old)));
+	else {
+		void *pt = palloc_get_page (0);
+		if (pt == NULL)
+			return false;
+		pt_reserve_push (pt);
+	}
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+
+	/* Flushes the TLB entries of every small page replaced. */
+	tlb_flush (pml4);
+	return true;
+}
+
+/* Splits the huge page at UPAGE in PML4 into HPG_PAGES small
+ * pages mapped to the same frames, with the same flags, so that
+ * they can be changed one at a time.  Does nothing if UPAGE is
+ * not in a huge page.  The page table comes from the reserve that
+ * pml4_set_huge_page() filled, so this cannot fail. */
+void
+pml4_demote_page (uint64_t *pml4, void *upage) {
+	uint64_t *pde = pde_walk (pml4, (uint64_t) upage, false);
+	uint64_t *pt, flags;
+	size_t i;
+
+	if (pde == NULL || !(*pde & PTE_P) || !(*pde & PTE_PS))
+		return;
+	pt = pt_reserve_pop ();
+	flags = *pde & PTE_FLAGS & ~(uint64_t) PTE_PS;
+	for (i = 0; i < HPG_PAGES; i++)
+		pt[i] = (PTE_ADDR (*pde) + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	tlb_flush_page (pml4, upage);
+}
+
+/* Adds PT, an unused page, to the page table reserve. */
+static void
+pt_reserve_push (void *pt) {
+	enum intr_level old_level = intr_disable ();
+	*(void **) pt = pt_reserve;
+	pt_reserve = pt;
+	intr_set_level (old_level);
+}
+
+/* Takes a page out of the page table reserve, which must hold one
+   for each huge page mapped. */
+static void *
+pt_reserve_pop (void) {
+	enum intr_level old_level = intr_disable ();
+	void *pt = pt_reserve;
+
+	ASSERT (pt != NULL);
+	pt_reserve = *(void **) pt;
+	intr_set_level (old_level);
+	return pt;
+}
+
+/* Returns true if UPAGE is mapped by a huge page in PML4. */
+bool
+pml4_is_huge (uint64_t *pml4, const void *upage) {
+	uint64_t *pde = pde_walk (pml4, (uint64_t) upage, false);
+	return pde != NULL && (*pde & PTE_P) && (*pde & PTE_PS);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
- * UPAGE need not be mapped. */
+ * UPAGE need not be mapped, but must not be in a huge page. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
@@ -254,11 +535,11 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	ASSERT (is_user_vaddr (upage));
 
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	ASSERT (pte == NULL || !(*pte & PTE_PS));
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_flush_page (pml4, upage);
 	}
 }
 
@@ -281,10 +562,26 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
-			*pte &= ~(uint32_t) PTE_D;
+			*pte &= ~(uint64_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_flush_page (pml4, vpage);
+	}
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+ * VPAGE in PML4, keeping the other bits, so a mapping can be made
+ * read-only, and later writable again, without losing its
+ * accessed and dirty bits. */
+void
+pml4_set_writable (uint64_t *pml4, const void *vpage, bool writable) {
+	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	if (pte) {
+		if (writable)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+
+		tlb_flush_page (pml4, vpage);
 	}
 }
 
@@ -307,9 +604,11 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		if (accessed)
 			*pte |= PTE_A;
 		else
-			*pte &= ~(uint32_t) PTE_A;
+			*pte &= ~(uint64_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
+		/* Not worth a flush elsewhere: a stale entry only keeps
+		   the CPU from setting the bit again for a while. */
+		if (pml4_is_active (pml4))
 			invlpg ((uint64_t) vpage);
 	}
 }
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,13 +25,61 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  A free block of order K is 2**K pages starting at
+   a physical page number that is a multiple of 2**K; its first
+   page holds the list element that links it into free_lists[K].
+   Blocks are aligned in physical memory, not just within the
+   pool, so that a 2 MB block can back a huge page.  A request
+   for N pages takes a block of the smallest order that fits,
+   splitting larger blocks as needed, and gives back the pages
+   past N.  Freed pages are merged with their buddies as far as
+   possible.  Every operation is O(log n) in the pool size.
+
+   Single pages are the common case, so a few recently freed ones
+   are kept on a small LIFO stack, `hot', without being merged.
+   They are merged only when a larger request cannot otherwise
+   be met.
+
+   Each pool also keeps a small reserve of pages that are already
+   zeroed, which the idle thread fills through palloc_zero_idle().
+   Single-page PAL_ZERO requests are served from the reserve, so
+   that page faults and process setup do not have to clear pages
+   themselves.  The reserve is given back to the buddy lists if
+   the pool would otherwise run out. */
+
+/* Largest block order: 2**18 pages, or 1 GB. */
+#define MAX_ORDER 18
+
+/* Most single pages kept on a pool's hot stack. */
+#define HOT_MAX 32
+
+/* Most pre-zeroed pages kept in a pool's reserve. */
+#define ZEROED_MAX 64
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t skew;                    /* Physical page number of BASE,
+	                                   modulo 2**MAX_ORDER. */
+	uint8_t *orders;                /* Per page: 1 + order if it heads a
+	                                   free block, otherwise 0. */
+	struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+	uint32_t nonempty;              /* Bit K set iff free_lists[K] is not. */
+	struct list hot;                /* Unmerged free single pages. */
+	size_t hot_cnt;                 /* Pages on `hot'. */
+
+	/* Pre-zeroed pages.  These are marked used in used_map.
+	   Protected by disabling interrupts rather than by LOCK, since
+	   the idle thread must never block. */
+	void *zeroed[ZEROED_MAX];       /* Stack of zeroed pages. */
+	size_t zeroed_cnt;              /* Pages in `zeroed'. */
+	unsigned long long zero_hits;   /* PAL_ZERO served from `zeroed'. */
+	unsigned long long zero_misses; /* PAL_ZERO cleared on demand. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +91,13 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void buddy_init (struct pool *);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void hot_drain (struct pool *);
+static size_t pool_take (struct pool *, size_t page_cnt);
+static void *zeroed_pop (struct pool *);
+static bool zeroed_release (struct pool *);
 
 /* multiboot info */
 struct multiboot_info {
@@ -232,6 +288,9 @@ split:
 			}
 		}
 	}
+
+	buddy_init (&kernel_pool);
+	buddy_init (&user_pool);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -258,13 +317,28 @@ palloc_init (void) {
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.
+   If PAGE_CNT is a power of two, the pages are aligned to
+   PAGE_CNT pages in physical memory, so HPG_PAGES of them can be
+   mapped as a huge page. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_idx = BITMAP_ERROR;
+
+	if (page_cnt == 0)
+		return NULL;
+
+	if (page_cnt == 1 && (flags & PAL_ZERO)) {
+		void *page = zeroed_pop (pool);
+		if (page != NULL)
+			return page;
+	}
 
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	page_idx = pool_take (pool, page_cnt);
+	if (page_idx == BITMAP_ERROR && zeroed_release (pool))
+		page_idx = pool_take (pool, page_cnt);
 	lock_release (&pool->lock);
 	void *pages;
 
@@ -318,8 +392,15 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	lock_acquire (&pool->lock);
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	if (page_cnt == 1 && pool->hot_cnt < HOT_MAX) {
+		list_push_front (&pool->hot, pages);
+		pool->hot_cnt++;
+	} else
+		buddy_free (pool, page_idx, page_cnt);
+	lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +409,57 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page into the reserve of a pool that is not
+   full.  Returns true if it did, false if there was nothing to
+   do or the work could not be done without blocking.
+
+   Called by the idle thread with interrupts on.  Only the copy
+   runs with interrupts on; the pool lock is held only with
+   interrupts off, so no thread can ever wait for the idle thread
+   to release it. */
+bool
+palloc_zero_idle (void) {
+	struct pool *pools[] = { &user_pool, &kernel_pool };
+	size_t i;
+
+	for (i = 0; i < sizeof pools / sizeof *pools; i++) {
+		struct pool *pool = pools[i];
+		enum intr_level old_level;
+		size_t page_idx = BITMAP_ERROR;
+		void *page;
+
+		old_level = intr_disable ();
+		if (pool->zeroed_cnt < ZEROED_MAX && lock_try_acquire (&pool->lock)) {
+			page_idx = pool_take (pool, 1);
+			lock_release (&pool->lock);
+		}
+		intr_set_level (old_level);
+		if (page_idx == BITMAP_ERROR)
+			continue;
+
+		page = pool->base + PGSIZE * page_idx;
+		memset (page, 0, PGSIZE);
+
+		/* We are the only thread that adds to the reserve, so it
+		   still has room. */
+		old_level = intr_disable ();
+		ASSERT (pool->zeroed_cnt < ZEROED_MAX);
+		pool->zeroed[pool->zeroed_cnt++] = page;
+		intr_set_level (old_level);
+		return true;
+	}
+	return false;
+}
+
+/* Prints statistics about the pre-zeroed page reserves. */
+void
+palloc_print_stats (void) {
+	printf ("Zeroed pages: kernel %llu hits, %llu misses; "
+			"user %llu hits, %llu misses\n",
+			kernel_pool.zero_hits, kernel_pool.zero_misses,
+			user_pool.zero_hits, user_pool.zero_misses);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -336,15 +468,22 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t order_pages = DIV_ROUND_UP (pgcnt, PGSIZE) * PGSIZE;
 
 	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
+	p->skew = pg_no (vtop (start)) & (((size_t) 1 << MAX_ORDER) - 1);
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
 
 	*bm_base += bm_pages;
+
+	/* The buddy allocator's order map follows the bitmap. */
+	p->orders = *bm_base;
+	memset (p->orders, 0, pgcnt);
+	*bm_base += order_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -356,3 +495,209 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the first page of the block at PAGE_IDX in POOL, used
+   to link the block into a list while it is free. */
+static struct list_elem *
+idx_to_elem (struct pool *pool, size_t page_idx) {
+	return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Adds the free block of ORDER at PAGE_IDX to POOL's free lists. */
+static void
+block_insert (struct pool *pool, size_t page_idx, int order) {
+	list_push_front (&pool->free_lists[order], idx_to_elem (pool, page_idx));
+	pool->orders[page_idx] = order + 1;
+	pool->nonempty |= 1u << order;
+}
+
+/* Removes the free block of ORDER at PAGE_IDX from POOL's free
+   lists. */
+static void
+block_remove (struct pool *pool, size_t page_idx, int order) {
+	ASSERT (pool->orders[page_idx] == order + 1);
+
+	list_remove (idx_to_elem (pool, page_idx));
+	pool->orders[page_idx] = 0;
+	if (list_empty (&pool->free_lists[order]))
+		pool->nonempty &= ~(1u << order);
+}
+
+/* Frees the block of ORDER at PAGE_IDX, merging it with its buddy
+   for as long as the buddy is free and whole. */
+static void
+block_free (struct pool *pool, size_t page_idx, int order) {
+	size_t pool_pages = bitmap_size (pool->used_map);
+
+	while (order < MAX_ORDER) {
+		size_t buddy = (page_idx + pool->skew) ^ ((size_t) 1 << order);
+
+		if (buddy < pool->skew)
+			break;
+		buddy -= pool->skew;
+		if (buddy >= pool_pages || pool->orders[buddy] != order + 1)
+			break;
+		block_remove (pool, buddy, order);
+		if (buddy < page_idx)
+			page_idx = buddy;
+		order++;
+	}
+	block_insert (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL as a
+   sequence of naturally aligned blocks, largest first. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	while (page_cnt > 0) {
+		size_t pos = page_idx + pool->skew;
+		int order = pos != 0 ? __builtin_ctzll (pos) : MAX_ORDER;
+
+		if (order > MAX_ORDER)
+			order = MAX_ORDER;
+		while (((size_t) 1 << order) > page_cnt)
+			order--;
+		block_free (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL's buddy lists and
+   returns the index of the first, or BITMAP_ERROR if no block is
+   big enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	int want = 0, order;
+	uint32_t fits;
+	size_t page_idx;
+
+	while (((size_t) 1 << want) < page_cnt)
+		if (++want > MAX_ORDER)
+			return BITMAP_ERROR;
+
+	/* Smallest nonempty order at least WANT. */
+	fits = pool->nonempty & ~((1u << want) - 1);
+	if (fits == 0)
+		return BITMAP_ERROR;
+	order = __builtin_ctz (fits);
+
+	page_idx = pg_no (list_front (&pool->free_lists[order])) - pg_no (pool->base);
+	block_remove (pool, page_idx, order);
+
+	/* Split off upper halves until the block is the size wanted. */
+	while (order > want) {
+		order--;
+		block_insert (pool, page_idx + ((size_t) 1 << order), order);
+	}
+
+	/* Give back the pages beyond PAGE_CNT. */
+	buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+	return page_idx;
+}
+
+/* Takes PAGE_CNT contiguous free pages from POOL and marks them
+   used.  Returns the index of the first one, or BITMAP_ERROR if
+   there is no such run.  POOL's lock must be held. */
+static size_t
+pool_take (struct pool *pool, size_t page_cnt) {
+	size_t page_idx;
+
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	if (page_cnt == 1 && pool->hot_cnt > 0) {
+		page_idx = pg_no (list_pop_front (&pool->hot)) - pg_no (pool->base);
+		pool->hot_cnt--;
+	} else {
+		page_idx = buddy_alloc (pool, page_cnt);
+		if (page_idx == BITMAP_ERROR && pool->hot_cnt > 0) {
+			hot_drain (pool);
+			page_idx = buddy_alloc (pool, page_cnt);
+		}
+	}
+	if (page_idx != BITMAP_ERROR) {
+		ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
+	return page_idx;
+}
+
+/* Pops a page off POOL's zeroed reserve and counts the PAL_ZERO
+   request as a hit, or counts it as a miss and returns a null
+   pointer if the reserve is empty. */
+static void *
+zeroed_pop (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	void *page = NULL;
+
+	if (pool->zeroed_cnt > 0) {
+		page = pool->zeroed[--pool->zeroed_cnt];
+		pool->zero_hits++;
+	} else
+		pool->zero_misses++;
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Gives all of POOL's zeroed reserve back to the buddy lists.
+   Returns true if there were any pages to give back.  POOL's
+   lock must be held. */
+static bool
+zeroed_release (struct pool *pool) {
+	enum intr_level old_level;
+	bool released;
+
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	old_level = intr_disable ();
+	released = pool->zeroed_cnt > 0;
+	while (pool->zeroed_cnt > 0) {
+		void *page = pool->zeroed[--pool->zeroed_cnt];
+		size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+		bitmap_reset (pool->used_map, page_idx);
+		buddy_free (pool, page_idx, 1);
+	}
+	intr_set_level (old_level);
+	return released;
+}
+
+/* Merges the pages on POOL's hot stack into the buddy lists. */
+static void
+hot_drain (struct pool *pool) {
+	while (!list_empty (&pool->hot)) {
+		void *page = list_pop_front (&pool->hot);
+		buddy_free (pool, pg_no (page) - pg_no (pool->base), 1);
+	}
+	pool->hot_cnt = 0;
+}
+
+/* Builds POOL's buddy lists from the free pages in its used_map,
+   which populate_pools() has filled in. */
+static void
+buddy_init (struct pool *pool) {
+	size_t pool_pages = bitmap_size (pool->used_map);
+	size_t page_idx = 0;
+	int order;
+
+	for (order = 0; order <= MAX_ORDER; order++)
+		list_init (&pool->free_lists[order]);
+	pool->nonempty = 0;
+	list_init (&pool->hot);
+	pool->hot_cnt = 0;
+	pool->zeroed_cnt = 0;
+	pool->zero_hits = pool->zero_misses = 0;
+
+	while (page_idx < pool_pages) {
+		size_t start = bitmap_scan (pool->used_map, page_idx, 1, false);
+		size_t end;
+
+		if (start == BITMAP_ERROR)
+			break;
+		end = bitmap_scan (pool->used_map, start, 1, true);
+		if (end == BITMAP_ERROR)
+			end = pool_pages;
+		buddy_free (pool, start, end - start);
+		page_idx = end;
+	}
+}
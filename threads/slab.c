@@ -0,0 +1,208 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A slab is one page: a struct slab header followed by as many
+   objects as fit.  Objects are carved off in address order the
+   first time they are needed, so a new slab costs nothing per
+   object until it is used.  Freed objects go on the slab's own
+   free chain.
+
+   Without a constructor the free chain is threaded through the
+   first word of each free object.  With a constructor that word
+   belongs to the constructed object, so each object is followed
+   by a link word of its own.
+
+   A cache keeps slabs that have free objects on `partial' and
+   forgets about full ones until an object in them is freed.  At
+   most one completely free slab is kept; others go back to the
+   page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Cache. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t obj_size;            /* Size requested by the creator. */
+	size_t stride;              /* Bytes from one object to the next. */
+	size_t link_ofs;            /* Offset of free link in object. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	kmem_ctor_func *ctor;       /* Constructor, or null. */
+	struct lock lock;           /* Protects everything below. */
+	struct list partial;        /* Slabs with free objects. */
+	size_t slab_cnt;            /* Number of slabs. */
+	size_t empty_cnt;           /* Number of completely free slabs. */
+	size_t in_use;              /* Objects allocated. */
+	size_t alloc_cnt;           /* kmem_cache_alloc() calls that succeeded. */
+	struct list_elem elem;      /* Element in `caches'. */
+};
+
+/* Slab header, at the start of its page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in cache's `partial'. */
+	size_t in_use;              /* Objects allocated. */
+	size_t carved;              /* Objects handed out at least once. */
+	void *free;                 /* First freed object, or null. */
+};
+
+/* All caches, for kmem_cache_print_stats(). */
+static struct list caches;
+
+/* Returns the free link of OBJ in cache C. */
+static inline void **
+obj_link (const struct kmem_cache *c, void *obj) {
+	return (void **) ((uint8_t *) obj + c->link_ofs);
+}
+
+/* Returns the slab that OBJ belongs to. */
+static struct slab *
+obj_to_slab (void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT ((pg_ofs (obj) - sizeof *s) % s->cache->stride == 0);
+	return s;
+}
+
+/* Initializes the object cache allocator. */
+void
+kmem_init (void) {
+	list_init (&caches);
+}
+
+/* Creates and returns a cache of SIZE-byte objects named NAME.
+   If CTOR is nonnull, it is called on every object before it is
+   first allocated.  Panics if memory is not available, since
+   caches are created during initialization. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor) {
+	struct kmem_cache *c;
+
+	ASSERT (name != NULL);
+	ASSERT (size > 0);
+
+	c = malloc (sizeof *c);
+	if (c == NULL)
+		PANIC ("kmem_cache_create: out of memory for cache %s", name);
+
+	c->name = name;
+	c->obj_size = size;
+	c->stride = ROUND_UP (size, sizeof (void *));
+	if (ctor != NULL) {
+		c->link_ofs = c->stride;
+		c->stride += sizeof (void *);
+	} else
+		c->link_ofs = 0;
+	ASSERT (c->stride <= PGSIZE - sizeof (struct slab));
+	c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->stride;
+	c->ctor = ctor;
+	lock_init (&c->lock);
+	list_init (&c->partial);
+	c->slab_cnt = c->empty_cnt = 0;
+	c->in_use = c->alloc_cnt = 0;
+	list_push_back (&caches, &c->elem);
+	return c;
+}
+
+/* Allocates and returns an object from cache C, or returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	struct slab *s;
+	void *obj;
+
+	ASSERT (c != NULL);
+
+	lock_acquire (&c->lock);
+	if (list_empty (&c->partial)) {
+		s = palloc_get_page (0);
+		if (s == NULL) {
+			lock_release (&c->lock);
+			return NULL;
+		}
+		s->magic = SLAB_MAGIC;
+		s->cache = c;
+		s->in_use = s->carved = 0;
+		s->free = NULL;
+		list_push_front (&c->partial, &s->elem);
+		c->slab_cnt++;
+		c->empty_cnt++;
+	}
+
+	s = list_entry (list_front (&c->partial), struct slab, elem);
+	if (s->free != NULL) {
+		obj = s->free;
+		s->free = *obj_link (c, obj);
+	} else {
+		ASSERT (s->carved < c->objs_per_slab);
+		obj = (uint8_t *) (s + 1) + s->carved++ * c->stride;
+		if (c->ctor != NULL)
+			c->ctor (obj);
+	}
+
+	if (s->in_use++ == 0)
+		c->empty_cnt--;
+	if (s->in_use == c->objs_per_slab)
+		list_remove (&s->elem);
+	c->in_use++;
+	c->alloc_cnt++;
+	lock_release (&c->lock);
+	return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+
+	ASSERT (c != NULL);
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab (obj);
+	ASSERT (s->cache == c);
+
+	lock_acquire (&c->lock);
+	ASSERT (s->in_use > 0);
+	*obj_link (c, obj) = s->free;
+	s->free = obj;
+	if (s->in_use-- == c->objs_per_slab)
+		list_push_front (&c->partial, &s->elem);
+	c->in_use--;
+
+	if (s->in_use == 0) {
+		if (c->empty_cnt > 0) {
+			list_remove (&s->elem);
+			c->slab_cnt--;
+			palloc_free_page (s);
+		} else
+			c->empty_cnt++;
+	}
+	lock_release (&c->lock);
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_cache_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		printf ("Cache %s: %zu in use, %zu allocs, %zu slabs "
+				"of %zu x %zu bytes\n",
+				c->name, c->in_use, c->alloc_cnt, c->slab_cnt,
+				c->objs_per_slab, c->obj_size);
+	}
+}
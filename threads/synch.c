@@ -41,6 +41,11 @@
 
    - up or "V": increment the value (and wake up one waiting
    thread, if any). */
+static bool waiter_less (const struct heap_elem *, const struct heap_elem *,
+		void *aux);
+static bool cond_waiter_less (const struct heap_elem *,
+		const struct heap_elem *, void *aux);
+
 // 세마포어를 초기화: 세마포어 구조체형성
 // 세마포어는 공유자원의 수와 그 공유 자원을 사용하려고 하는 쓰레드의 대기줄이있다. 
 void
@@ -48,7 +53,7 @@ sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
+	heap_init (&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -69,9 +74,17 @@ sema_down (struct semaphore *sema) {
 
 	old_level = intr_disable ();
 
-	// 공유자원이 0이면 쓰레드를 맨뒤로
+	// 공유자원이 0이면 쓰레드를 우선순위 순서대로 대기
 	while (sema->value == 0) {
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, priority_compare, NULL);
+		struct thread *cur = thread_current ();
+
+		heap_push (&sema->waiters, &cur->wait_elem);
+		/* Inside cond_wait() the condition's queue is the one that
+		   follows our priority; this semaphore has no other waiter. */
+		if (cur->wait_queue == NULL) {
+			cur->wait_queue = &sema->waiters;
+			cur->wait_node = &cur->wait_elem;
+		}
 		thread_block (); //현재 쓰레드 제우기
 	}
 	sema->value--; // sema-> value가 0이 아닐때
@@ -114,9 +127,13 @@ void sema_up (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters)){
-    	list_sort(&sema->waiters,priority_compare,NULL);
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),struct thread, elem));
+	if (!heap_empty (&sema->waiters)) {
+		struct thread *t = heap_entry (heap_pop (&sema->waiters),
+				struct thread, wait_elem);
+
+		if (t->wait_node == &t->wait_elem)
+			t->wait_queue = NULL;
+		thread_unblock (t);
 	}
 	sema->value++;
    preempt();
@@ -158,6 +175,17 @@ sema_test_helper (void *sema_) {
 	}
 }
 
+static void lock_acquired (struct lock *);
+static void rw_donate (struct rwlock *);
+
+/* Orders a lock's donors by their current priority. */
+static bool
+donor_less (const struct heap_elem *a, const struct heap_elem *b,
+		void *aux UNUSED) {
+	return heap_entry (a, struct thread, donation_elem)->priority
+		< heap_entry (b, struct thread, donation_elem)->priority;
+}
+
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -179,38 +207,71 @@ lock_init (struct lock *lock) {
 
 	lock->holder = NULL;
 	sema_init (&lock->semaphore, 1);
+	heap_init (&lock->donors, donor_less, NULL);
+}
+
+/* Number of times lock_acquire() polls a lock whose holder is
+   running on another CPU before giving up and sleeping. */
+#define LOCK_SPIN_LIMIT 1000
+
+/* Spins while LOCK's holder is running, since a running holder
+   is likely to release the lock sooner than a sleep and wakeup
+   would take.  Returns as soon as the lock is free, its holder
+   stops running, or LOCK_SPIN_LIMIT polls have been made.
+
+   A holder can only be running while we are if it is on another
+   CPU, so on a uniprocessor this returns immediately. */
+static void
+lock_spin (struct lock *lock) {
+	for (int i = 0; i < LOCK_SPIN_LIMIT; i++) {
+		struct thread *holder = lock->holder;
+
+		if (holder == NULL || holder->status != THREAD_RUNNING)
+			return;
+		__asm __volatile ("pause" : : : "memory");
+	}
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   An uncontended lock is taken without any donation bookkeeping.
+   A contended one is polled briefly while its holder is running
+   elsewhere, then the holder receives our priority and we sleep.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 void
 lock_acquire (struct lock *lock) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
+
+	old_level = intr_disable ();
+	if (lock->holder != NULL)
+		lock_spin (lock);
+
 	//(P1:P-Donation) 
-	struct thread *cur = thread_current();
-	if (!thread_mlfqs){
-		
-		if (lock->holder != NULL){ // 현재 lock이 점유중일때는 
-			cur->wait_on_lock = lock; // 현재 스레드(기다려야 하는)의 wait_on_lock으로 지정
-			list_push_back(&lock->holder->donations, &cur->donation_elem);
-			donate_priority();
-    	}
-		
+	if (lock->holder != NULL && !thread_mlfqs) { // 현재 lock이 점유중일때는 
+		cur->wait_on_lock = lock; // 현재 스레드(기다려야 하는)의 wait_on_lock으로 지정
+		heap_push (&lock->donors, &cur->donation_elem);
+		update_priority (lock->holder);
 	}
-    
 
 	sema_down (&lock->semaphore);
 	//(P1:P-Donation) 
-	cur->wait_on_lock = NULL; // lock을 점유했으니 wait_on_lock에서 제거
-	lock->holder = thread_current ();
+	if (cur->wait_on_lock != NULL) {
+		heap_remove (&lock->donors, &cur->donation_elem);
+		cur->wait_on_lock = NULL; // lock을 점유했으니 wait_on_lock에서 제거
+	}
+	lock_acquired (lock);
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -221,17 +282,34 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
 	if (success)
-		lock->holder = thread_current ();
+		lock_acquired (lock);
+	intr_set_level (old_level);
 	return success;
 }
 
+/* Makes the current thread the holder of LOCK, which it has just
+   taken.  Threads still waiting on LOCK now donate to it. */
+static void
+lock_acquired (struct lock *lock) {
+	struct thread *cur = thread_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	lock->holder = cur;
+	list_push_back (&cur->held_locks, &lock->elem);
+	if (!thread_mlfqs && !heap_empty (&lock->donors))
+		update_priority (cur);
+}
+
 /* Releases LOCK, which must be owned by the current thread.
    This is lock_release function.
 
@@ -240,19 +318,19 @@ lock_try_acquire (struct lock *lock) {
    handler. */
 void
 lock_release (struct lock *lock) {
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
-   /*thread_mlfqs가 False일때만 실행*/
-    if (!thread_mlfqs)
-    {
-       remove_donor(lock);
-       update_priority();
-    }
-
-
+	old_level = intr_disable ();
+	list_remove (&lock->elem);
 	lock->holder = NULL;
+	/* LOCK's waiters stop donating to us. */
+	if (!thread_mlfqs)
+		update_priority (thread_current ());
 	sema_up (&lock->semaphore);
+	intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -265,10 +343,147 @@ lock_held_by_current_thread (const struct lock *lock) {
 	return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* Initializes reader-writer lock RW, which is not held.
+
+   The writer holds RW's embedded lock for as long as it writes,
+   so threads that queue behind a writer donate their priority to
+   it as usual.  A writer waiting for readers to leave donates
+   its priority to them in turn; see update_priority(). */
+void
+rw_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	rw->readers = 0;
+	list_init (&rw->reader_list);
+	rw->writer = NULL;
+	sema_init (&rw->drained, 0);
+}
+
+/* Counts the current thread as a reader of RW.  A thread receives
+   donation through only one rwlock it reads at a time; a nested
+   read of a second rwlock is counted but not tracked. */
+static void
+rw_add_reader (struct rwlock *rw) {
+	struct thread *cur = thread_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	rw->readers++;
+	if (cur->read_lock == NULL) {
+		cur->read_lock = rw;
+		list_push_back (&rw->reader_list, &cur->read_elem);
+	}
+}
+
+/* Recomputes the priority of each reader tracked in RW, whose
+   waiting writer's priority is now donated to them.  Interrupts
+   must be off. */
+static void
+rw_donate (struct rwlock *rw) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&rw->reader_list); e != list_end (&rw->reader_list);
+			e = list_next (e))
+		update_priority (list_entry (e, struct thread, read_elem));
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it.  If nobody is writing this only records the
+   current thread as a reader. */
+void
+rw_read_acquire (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rw_write_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	if (rw->lock.holder == NULL)
+		rw_add_reader (rw);
+	else {
+		/* Queue behind the writer, then let the next one in. */
+		lock_acquire (&rw->lock);
+		rw_add_reader (rw);
+		lock_release (&rw->lock);
+	}
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for reading.  The
+   reader stops receiving the waiting writer's priority, and the
+   last reader to leave wakes the writer. */
+void
+rw_read_release (struct rwlock *rw) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+
+	old_level = intr_disable ();
+	ASSERT (rw->readers > 0);
+	if (cur->read_lock == rw) {
+		list_remove (&cur->read_elem);
+		cur->read_lock = NULL;
+		if (rw->writer != NULL && !thread_mlfqs)
+			update_priority (cur);
+	}
+	if (--rw->readers == 0 && rw->writer != NULL) {
+		rw->writer = NULL;
+		sema_up (&rw->drained);
+	}
+	intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other writer holds
+   it and all readers have left.  New readers wait from the
+   moment the embedded lock is taken, and the readers still inside
+   run with at least our priority until they leave. */
+void
+rw_write_acquire (struct rwlock *rw) {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	if (rw->readers > 0) {
+		rw->writer = cur;
+		cur->wait_on_rw = rw;
+		if (!thread_mlfqs)
+			rw_donate (rw);
+		sema_down (&rw->drained);
+		cur->wait_on_rw = NULL;
+	}
+	ASSERT (rw->readers == 0);
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rw_write_release (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing. */
+bool
+rw_write_held_by_current_thread (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return lock_held_by_current_thread (&rw->lock);
+}
+
+/* One semaphore in a condition's waiters. */
 struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
+	struct heap_elem elem;              /* Heap element. */
 	struct semaphore semaphore;         /* This semaphore. */
+	struct thread *thread;              /* Thread waiting on it. */
 };
 
 /* Initializes condition variable COND.  A condition variable
@@ -278,7 +493,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -304,6 +519,7 @@ cond_init (struct condition *cond) {
 void
 cond_wait (struct condition *cond, struct lock *lock) {
 	struct semaphore_elem waiter;
+	enum intr_level old_level;
 
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
@@ -311,7 +527,14 @@ cond_wait (struct condition *cond, struct lock *lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
-	list_push_back (&cond->waiters, &waiter.elem);
+	waiter.thread = thread_current ();
+
+	old_level = intr_disable ();
+	heap_push (&cond->waiters, &waiter.elem);
+	waiter.thread->wait_queue = &cond->waiters;
+	waiter.thread->wait_node = &waiter.elem;
+	intr_set_level (old_level);
+
 	lock_release (lock);
 	sema_down (&waiter.semaphore);
 	lock_acquire (lock);
@@ -326,15 +549,22 @@ cond_wait (struct condition *cond, struct lock *lock) {
    interrupt handler. */
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) {
+	enum intr_level old_level;
+
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
-	if (!list_empty (&cond->waiters)){
-      list_sort(&cond->waiters, sema_compare, NULL);
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
-   }
+
+	old_level = intr_disable ();
+	if (!heap_empty (&cond->waiters)) {
+		struct semaphore_elem *waiter = heap_entry (heap_pop (&cond->waiters),
+				struct semaphore_elem, elem);
+
+		waiter->thread->wait_queue = NULL;
+		sema_up (&waiter->semaphore);
+	}
+	intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -348,76 +578,71 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!heap_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
-//(P1:Sema)
-bool sema_compare(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) 
-{
-	struct semaphore_elem *sa = list_entry(a, struct semaphore_elem, elem);
-    struct semaphore_elem *sb = list_entry(b, struct semaphore_elem, elem);
-
-	struct list *sal = &(sa->semaphore.waiters);
-	struct list *sbl = &(sb->semaphore.waiters);
-
-	struct list_elem * head_a = list_begin(sal);
-	struct list_elem * head_b = list_begin(sbl);
-	
-	struct thread *ta = list_entry(head_a, struct thread, elem);
-    struct thread *tb = list_entry(head_b, struct thread, elem);
-    return ta->priority > tb->priority;
+//(P1:Sema) 대기 중인 스레드들을 현재 우선순위로 정렬
+/* Orders a semaphore's waiters by their current priority. */
+static bool
+waiter_less (const struct heap_elem *a, const struct heap_elem *b,
+		void *aux UNUSED) {
+	return heap_entry (a, struct thread, wait_elem)->priority
+		< heap_entry (b, struct thread, wait_elem)->priority;
 }
 
-//(P1:P-Donation) 현재 스레드가 원하는 락을 가진 holder에게 현재 스레드의 priority 상속
-void donate_priority(void)
-{
-   struct thread *cur = thread_current(); // 검사중인 스레드
-   struct thread *holder;  // cur이 원하는 락을 가진드스레드
-
-   int priority = cur->priority;
-
-   while (cur->wait_on_lock != NULL) //nested를 고려해서 연결된 모든 쓰레드에 대해 우선순위 기부하기
-   {
-      holder = cur->wait_on_lock->holder;
-      holder->priority = priority;
-      cur = holder;
-   }
-}
-//(P1:P-Donation)
-void remove_donor(struct lock *lock)
-{
-    struct list *donations = &(thread_current()->donations); // 현재 스레드의 donations
-    struct list_elem *donor_elem;    // 현재 스레드의 donations의 요소
-    struct thread *donor_thread;
-
-    if (list_empty(donations))
-        return;
-
-    donor_elem = list_front(donations);
-
-    while (1)
-    {
-        donor_thread = list_entry(donor_elem, struct thread, donation_elem);
-        if (donor_thread->wait_on_lock == lock)           // 현재 release될 lock을 기다리던 스레드라면
-            list_remove(&donor_thread->donation_elem); // 목록에서 제거
-        donor_elem = list_next(donor_elem);
-        if (donor_elem == list_end(donations))
-            return;
-    }
+/* Orders a condition's waiters by the current priority of the
+   thread waiting on each semaphore. */
+static bool
+cond_waiter_less (const struct heap_elem *a, const struct heap_elem *b,
+		void *aux UNUSED) {
+	return heap_entry (a, struct semaphore_elem, elem)->thread->priority
+		< heap_entry (b, struct semaphore_elem, elem)->thread->priority;
 }
-//(P1:P-Donation)
-void update_priority(void)
-{
-    struct thread *curr = thread_current();
-    struct list *donations = &(thread_current()->donations);
-    struct thread *donations_root;
-
-    if (list_empty(donations)) // donors가 없으면 (donor가 하나였던 경우)
-    {
-        curr->priority = curr->org_priority; // 최초의 priority로 변경
-        return;
-    }
-
-    donations_root = list_entry(list_front(donations), struct thread, donation_elem);
-    curr->priority = donations_root->priority;
+
+//(P1:P-Donation) 우선순위 재계산: org_priority와 보유한 lock들의 최고 donor 중 최댓값
+/* Recomputes T's priority as the maximum of its own priority and
+   the top donor of each lock it holds, which is O(locks held),
+   and of the writer waiting on the rwlock T reads, if any.
+   If T's priority changes while T is waiting on a lock, T is
+   re-keyed in that lock's donors and the lock's holder is
+   recomputed in turn, down the chain of nested donations until
+   some priority stays the same.  A writer waiting for an
+   rwlock's readers passes the change on to each of them.
+   Interrupts must be off. */
+void
+update_priority (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (t != NULL) {
+		int priority = t->org_priority;
+		struct list_elem *e;
+		struct lock *lock;
+
+		for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+				e = list_next (e)) {
+			struct heap_elem *top = heap_top (&list_entry (e, struct lock, elem)->donors);
+
+			if (top != NULL) {
+				struct thread *donor = heap_entry (top, struct thread, donation_elem);
+				if (donor->priority > priority)
+					priority = donor->priority;
+			}
+		}
+		if (t->read_lock != NULL && t->read_lock->writer != NULL
+				&& t->read_lock->writer->priority > priority)
+			priority = t->read_lock->writer->priority;
+		if (priority == t->priority)
+			return;
+		thread_change_priority (t, priority);
+
+		if (t->wait_on_rw != NULL) {
+			rw_donate (t->wait_on_rw);
+			return;
+		}
+		lock = t->wait_on_lock;
+		if (lock == NULL)
+			return;
+		heap_update (&lock->donors, &t->donation_elem);
+		t = lock->holder;
+	}
 }
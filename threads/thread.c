@@ -8,6 +8,7 @@
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
@@ -28,15 +29,44 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list; //준비 상태의 쓰레드의 리스트
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority level; bit P of
+   ready_bitmap is set iff ready_queues[P] is non-empty, so the
+   highest ready priority is found with a single bit scan. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static size_t ready_cnt;        /* # of threads in the run queue. */
+#if PRI_MAX >= 64
+#error ready_bitmap requires PRI_MAX < 64
+#endif
 
-static struct list sleep_list; //(p1): sleeping thread list
+/* Sleeping threads, kept in a hierarchical timing wheel keyed on
+   wakeup_tick.  Level L has SLEEP_WHEEL_SIZE slots, each covering
+   SLEEP_WHEEL_SIZE^L ticks.  A sleeper goes into the lowest level
+   whose span covers its remaining delay; whenever the low bits of
+   the current tick wrap around, the matching slot one level up is
+   cascaded down.  Insertion is O(1) and each tick only touches the
+   slot that expires, plus the occasional cascade. */
+#define SLEEP_WHEEL_BITS 6
+#define SLEEP_WHEEL_SIZE (1 << SLEEP_WHEEL_BITS)
+#define SLEEP_WHEEL_MASK (SLEEP_WHEEL_SIZE - 1)
+#define SLEEP_WHEEL_LEVELS 4
+static struct list sleep_wheel[SLEEP_WHEEL_LEVELS][SLEEP_WHEEL_SIZE];
+static int64_t sleep_wheel_tick;  /* Next tick to be processed. */
+static size_t sleep_cnt;          /* # of threads in the wheel. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
 
+/* Under the mlfqs scheduler, the once-per-second recent_cpu decay
+   walks every thread.  Rather than doing that inside the timer
+   interrupt, the handler ups mlfqs_sema and this PRI_MAX thread
+   does the walk right after the interrupt returns.  It is excluded
+   from the mlfqs bookkeeping, like the idle thread. */
+static struct thread *mlfqs_thread;
+static struct semaphore mlfqs_sema;
+
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -63,16 +93,17 @@ bool thread_mlfqs;
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED); // 시스템에 실행할 다른 스레드가 없을 때 실행. CPU가 항상 뭔가를 실행하고 있도록 보장
+static void mlfqs_worker (void *aux UNUSED);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static void do_schedule(int status);
 static void schedule (void);
 static tid_t allocate_tid (void);
-
-
-// (P1: Alram clock): thread 재우고 깨우고
-void thread_sleep(int64_t ticks);
-void thread_awake(int64_t current_ticks);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static void sleep_wheel_insert (struct thread *);
+static void sleep_wheel_advance (void);
 
 
 
@@ -130,9 +161,17 @@ thread_init (void) {
 	
 	list_init (&destruction_req);//제거될 스레드들의 리스트를 초기화
 	
-	list_init (&sleep_list); //(P1): sleeping thread들 저장할 리스트
+	for (int i = 0; i < SLEEP_WHEEL_LEVELS; i++)
+		for (int j = 0; j < SLEEP_WHEEL_SIZE; j++)
+			list_init (&sleep_wheel[i][j]);
+	sleep_wheel_tick = 0;
+	sleep_cnt = 0;
 	list_init(&all_list);
-	list_init(&ready_list);
+	sema_init (&mlfqs_sema, 0);
+	for (int i = PRI_MIN; i <= PRI_MAX; i++)
+		list_init (&ready_queues[i]);
+	ready_bitmap = 0;
+	ready_cnt = 0;
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread (); //시스템 부팅 직후부터 존재했던 초기 실행 흐름: 부트로더가 실행되어 커널을 메모리에 로드 -> 하나의 실행 흐름(즉, 스레드)이 존재
 	init_thread (initial_thread, "main", PRI_DEFAULT); //(struct thread *t, const char *name, int priority)
@@ -155,6 +194,9 @@ thread_start (void) {
 
 	/* Wait for the idle thread to initialize idle_thread. */
 	sema_down (&idle_started);
+
+	if (thread_mlfqs)
+		thread_create ("mlfqs", PRI_MAX, mlfqs_worker, NULL);
 }
 
 /* Called by the timer interrupt handler at each timer tick.
@@ -178,11 +220,38 @@ thread_tick (void) {
 		intr_yield_on_return ();
 }
 
+/* Charges N timer ticks that went by without a timer interrupt,
+   because the periodic tick was stopped, to the running thread's
+   statistics. */
+void
+thread_account_ticks (int64_t n) {
+	struct thread *t = running_thread ();
+
+	if (t == idle_thread)
+		idle_ticks += n;
+#ifdef USERPROG
+	else if (t->pml4 != NULL)
+		user_ticks += n;
+#endif
+	else
+		kernel_ticks += n;
+}
+
+/* Returns true if the running thread is not the idle thread and
+   nothing else is in the run queue, so that no preemption can
+   happen until some thread is unblocked. */
+bool
+thread_is_alone (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	return ready_cnt == 0 && running_thread () != idle_thread;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) {
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	kmem_cache_print_stats ();
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -274,9 +343,9 @@ thread_unblock (struct thread *t) {
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	//list_push_back (&ready_list, &t->elem);
-	list_insert_ordered(&ready_list, &t->elem, priority_compare, NULL);
+	ready_queue_push (t);
 	t->status = THREAD_READY;
+	timer_tickless_exit ();
 	intr_set_level (old_level);
 }
 
@@ -319,10 +388,13 @@ thread_exit (void) {
 #ifdef USERPROG
 	process_exit ();
 #endif
+	malloc_thread_exit ();
 
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
+	if (thread_mlfqs)
+		list_remove (&thread_current ()->allelem);
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
 }
@@ -338,15 +410,9 @@ thread_yield (void) {
 
 	old_level = intr_disable ();
 	
-	// //ready_list는 현제 쓰레드들이 일자로 쭉 나열되어 있음
-	// // list_push_back으로 현재 쓰레드를 맨 뒤로 보냄
-	
-	// 	list_push_back (&ready_list, &curr->elem);
-	if (curr != idle_thread) {
-		list_insert_ordered(&ready_list, &curr->elem, priority_compare, NULL); // 우선순위 대로 삽입
-	}
-	
-	
+	if (curr != idle_thread)
+		ready_queue_push (curr);
+
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
@@ -355,10 +421,14 @@ thread_yield (void) {
 
 void thread_set_priority(int new_priority)
 {
+	enum intr_level old_level;
+
 	if (thread_mlfqs) return;
-    thread_current()->org_priority = new_priority;
-    update_priority();
-    preempt();
+	old_level = intr_disable ();
+	thread_current ()->org_priority = new_priority;
+	update_priority (thread_current ());
+	intr_set_level (old_level);
+	preempt ();
 }
 
 /* Returns the current thread's priority. */
@@ -439,6 +509,21 @@ idle (void *idle_started_ UNUSED) { //UNUSED는 컴파일러 경고를 방지하
 		intr_disable ();
 		thread_block ();
 
+		/* Spend the idle time zeroing pages for palloc's reserve,
+		   a page at a time, until some thread becomes ready.  If one
+		   did, go schedule it instead of halting. */
+		while (ready_cnt == 0) {
+			bool zeroed;
+
+			intr_enable ();
+			zeroed = palloc_zero_idle ();
+			intr_disable ();
+			if (!zeroed)
+				break;
+		}
+		if (ready_cnt > 0)
+			continue;
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -451,6 +536,7 @@ idle (void *idle_started_ UNUSED) { //UNUSED는 컴파일러 경고를 방지하
 
 		   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
 		   7.11.1 "HLT Instruction". */
+		timer_tickless_enter ();
 		asm volatile ("sti; hlt" : : : "memory");
 	}
 }
@@ -481,12 +567,14 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->tf.rsp = (uint64_t) t + PGSIZE - sizeof (void *);
 	t->priority = priority;
 	t->magic = THREAD_MAGIC; // 무결성 검사 이숫자를 넣어줌으로써 통과 된 쓰레드다 
+	list_init (&t->held_locks);
+	t->read_lock = NULL;
+	t->wait_on_rw = NULL;
 	//(P1:mlfqs)
 	if (!thread_mlfqs){
 		//(P1:P-Donation) 
 		t->org_priority = priority; // (P1:P-Donation)
 		t->wait_on_lock = NULL; // (P1:P-Donation)
-		list_init(&(t->donations));
 	}else{
 		//(P1:mlfqs)
 		//mlfqs_calculate_priority(t);
@@ -522,10 +610,75 @@ init_thread (struct thread *t, const char *name, int priority) {
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
+	int priority = ready_queue_max_priority ();
+	struct thread *t;
+
+	if (priority < 0)
 		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+	t = list_entry (list_front (&ready_queues[priority]), struct thread, elem);
+	ready_queue_remove (t);
+	return t;
+}
+
+/* Appends T to the run queue of its current priority.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+	list_push_back (&ready_queues[t->priority], &t->elem);
+	ready_bitmap |= 1ULL << t->priority;
+	ready_cnt++;
+}
+
+/* Removes T, which must be in the run queue of its current
+   priority.  Interrupts must be off. */
+static void
+ready_queue_remove (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	list_remove (&t->elem);
+	if (list_empty (&ready_queues[t->priority]))
+		ready_bitmap &= ~(1ULL << t->priority);
+	ready_cnt--;
+}
+
+/* Returns the highest priority that has a ready thread, or -1 if
+   the run queue is empty. */
+static int
+ready_queue_max_priority (void) {
+	if (ready_bitmap == 0)
+		return -1;
+	return 63 - __builtin_clzll (ready_bitmap);
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is in the run
+   queue it is moved to the tail of the new priority's queue, so
+   donation and mlfqs recalculation stay O(1).  If T is blocked in
+   a wait queue ordered by priority, it is re-keyed there.  Does
+   not preempt the running thread; call preempt() for that. */
+void
+thread_change_priority (struct thread *t, int priority) {
+	enum intr_level old_level;
+
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	old_level = intr_disable ();
+	if (t->priority != priority) {
+		if (t->status == THREAD_READY) {
+			ready_queue_remove (t);
+			t->priority = priority;
+			ready_queue_push (t);
+		} else {
+			t->priority = priority;
+			if (t->wait_queue != NULL)
+				heap_update (t->wait_queue, t->wait_node);
+		}
+	}
+	intr_set_level (old_level);
 }
 
 /* Use iretq to launch the thread */
@@ -678,6 +831,9 @@ static void schedule (void) {
 			list_push_back (&destruction_req, &curr->elem);
 		}
 
+		/* The tick may have been stopped for CURR alone. */
+		timer_tickless_exit ();
+
 		/* Before switching the thread, we first save the information
 		 * of current running. */
 		thread_launch (next);
@@ -697,22 +853,7 @@ allocate_tid (void) {
 	return tid;
 }
 
-// (P1): 제울 쓰레드와 현재 sleep_list 의 ticks들 하나하나 비교 하는 함수
-bool ticks_compare(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
-    struct thread *sa = list_entry(a, struct thread, elem);
-    struct thread *sb = list_entry(b, struct thread, elem);
-    return sa->wakeup_tick < sb->wakeup_tick;
-}
-// (P1): 제울 쓰레드와 현재 sleep_list 의 priority들 하나하나 비교 하는 함수
-bool
-priority_compare(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) 
-{
-    struct thread *ta = list_entry(a, struct thread, elem);
-    struct thread *tb = list_entry(b, struct thread, elem);
-    return ta->priority > tb->priority;
-}
-
-// (P1) thread를 sleep(동작하지 않도록) 하고 sleep_list에 넣기
+// (P1) thread를 sleep(동작하지 않도록) 하고 sleep wheel에 넣기
 void thread_sleep(int64_t ticks) {
     struct thread *cur = thread_current();
     enum intr_level old_level;
@@ -722,41 +863,125 @@ void thread_sleep(int64_t ticks) {
     old_level = intr_disable();
 
 	cur->wakeup_tick = timer_ticks() + ticks;// 일어날 시간 넣어주기
-	
-	list_insert_ordered(&sleep_list, &cur->elem, ticks_compare, NULL);// 리스트에 넣어주기
+
+	sleep_wheel_insert (cur);
 	thread_block(); // 현재 쓰래드 재우기
 
     intr_set_level(old_level);
 }
 
 // (P1): 잠자는 함수 깨우기
+/* Wakes up every sleeper whose wakeup_tick is at or before
+   CURRENT_TICKS.  Ticks that were not processed yet are caught
+   up one by one, so callers may skip ticks. */
 void thread_awake(int64_t current_ticks) {
-    struct list_elem *e = list_begin(&sleep_list);
-
-    while (e != list_end(&sleep_list)) {
-        struct thread *t = list_entry(e, struct thread, elem);
-        if (t->wakeup_tick <= current_ticks) {
-            e = list_remove(e);
-            thread_unblock(t);
-        } else {
-            // 리스트가 정렬되어 있으므로, 더 이상 깨울 스레드가 없으면 종료
-            break;
-        }
-    }
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (sleep_cnt == 0) {
+		if (sleep_wheel_tick <= current_ticks)
+			sleep_wheel_tick = current_ticks + 1;
+		return;
+	}
+	while (sleep_wheel_tick <= current_ticks)
+		sleep_wheel_advance ();
 }
 
-// (P1:P) 현재 쓰레드의 우선순위가 감소 했을때 바로 CPU사용권 넘기기
-void preempt(void) {
-	struct thread *cur = thread_current(); // 현재 쓰레드
+/* Returns a tick no later than the earliest wakeup_tick in the
+   sleep wheel, or INT64_MAX if nobody is asleep.  Only level 0 is
+   scanned; anything in a higher level cannot expire before that
+   level's next cascade. */
+int64_t
+thread_next_wakeup (void) {
+	int64_t cascade;
+	int i;
 
-	if (list_empty(&ready_list)){
-		return;
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (sleep_cnt == 0)
+		return INT64_MAX;
+
+	cascade = (sleep_wheel_tick + SLEEP_WHEEL_MASK) & ~(int64_t) SLEEP_WHEEL_MASK;
+	for (i = 0; sleep_wheel_tick + i < cascade; i++)
+		if (!list_empty (&sleep_wheel[0][(sleep_wheel_tick + i) & SLEEP_WHEEL_MASK]))
+			return sleep_wheel_tick + i;
+	return cascade;
+}
+
+/* Puts T into the wheel slot that covers its wakeup_tick.
+   Interrupts must be off. */
+static void
+sleep_wheel_insert (struct thread *t) {
+	int64_t expires = t->wakeup_tick;
+	int64_t delta;
+	int level;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	/* Already due: fire on the next processed tick.  Too far out:
+	   park in the top level, and the cascade will re-insert it
+	   using the real wakeup_tick. */
+	if (expires < sleep_wheel_tick)
+		expires = sleep_wheel_tick;
+	delta = expires - sleep_wheel_tick;
+	if (delta >= 1LL << (SLEEP_WHEEL_BITS * SLEEP_WHEEL_LEVELS)) {
+		delta = (1LL << (SLEEP_WHEEL_BITS * SLEEP_WHEEL_LEVELS)) - 1;
+		expires = sleep_wheel_tick + delta;
+	}
+
+	for (level = 0; level < SLEEP_WHEEL_LEVELS - 1; level++)
+		if (delta < 1LL << (SLEEP_WHEEL_BITS * (level + 1)))
+			break;
+
+	list_push_back (&sleep_wheel[level][(expires >> (SLEEP_WHEEL_BITS * level))
+	                                    & SLEEP_WHEEL_MASK], &t->elem);
+	sleep_cnt++;
+}
+
+/* Processes tick sleep_wheel_tick: cascades higher levels whose
+   slot boundary is reached, then wakes every thread in the level 0
+   slot, and moves on to the next tick. */
+static void
+sleep_wheel_advance (void) {
+	int64_t now = sleep_wheel_tick;
+	struct list *slot;
+	int level;
+
+	for (level = 1; level < SLEEP_WHEEL_LEVELS; level++) {
+		/* Lower levels have not wrapped around yet. */
+		if ((now & ((1LL << (SLEEP_WHEEL_BITS * level)) - 1)) != 0)
+			break;
+
+		slot = &sleep_wheel[level][(now >> (SLEEP_WHEEL_BITS * level))
+		                           & SLEEP_WHEEL_MASK];
+		/* Take the whole slot first, since re-inserting may hand a
+		   thread back to this same slot if it is parked. */
+		struct list cascade;
+		list_init (&cascade);
+		while (!list_empty (slot))
+			list_push_back (&cascade, list_pop_front (slot));
+		while (!list_empty (&cascade)) {
+			sleep_cnt--;
+			sleep_wheel_insert (list_entry (list_pop_front (&cascade),
+			                                struct thread, elem));
+		}
+	}
+
+	slot = &sleep_wheel[0][now & SLEEP_WHEEL_MASK];
+	while (!list_empty (slot)) {
+		struct thread *t = list_entry (list_pop_front (slot), struct thread, elem);
+		ASSERT (t->wakeup_tick <= now);
+		sleep_cnt--;
+		thread_unblock (t);
 	}
+	sleep_wheel_tick++;
+}
 
-	struct thread *next = list_entry(list_begin(&ready_list), struct thread, elem);
+// (P1:P) 현재 쓰레드의 우선순위가 감소 했을때 바로 CPU사용권 넘기기
+void preempt(void) {
+	struct thread *cur = thread_current(); // 현재 쓰레드
 
     // If the unblocked thread has a higher priority, force a yield immediately
-    if (cur != idle_thread && cur->priority < next->priority) {
+    if (cur != idle_thread && cur->priority < ready_queue_max_priority ()) {
 		if (intr_context()){
 			// 인터럽트 컨텍스트에서 호출된 경우: 인터럽트 종료 후 스케줄링
 			intr_yield_on_return();
@@ -773,25 +998,26 @@ void preempt(void) {
 
 
 void mlfqs_calculate_priority(struct thread *t) {
-	if (t == idle_thread)
+	if (t == idle_thread || t == mlfqs_thread)
 		return;
 	// 우선순위 계산을 위한 중간 값 계산
 	int recent_cpu_term = DIV_FP_INT(t->recent_cpu, 4); // recent_cpu / 4
 	int nice_term = INT_FP(t->nice * 2);				// nice * 2 (고정 소수점 변환)
 	// 우선순위 계산
 	int priority_fp = SUB_FP(SUB_FP(INT_FP(PRI_MAX), recent_cpu_term), nice_term);
-	t->priority = FP_TO_INT(priority_fp);
+	int priority = FP_TO_INT(priority_fp);
 
-	if (t->priority < PRI_MIN)
-		t->priority = PRI_MIN;
-	else if (t->priority > PRI_MAX)
-		t->priority = PRI_MAX;
+	if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	else if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	thread_change_priority (t, priority);
 }
 
 
 
 void mlfqs_calculate_recent_cpu(struct thread *t) {
-    if (t == idle_thread) return;
+    if (t == idle_thread || t == mlfqs_thread) return;
 
     ASSERT(t->nice >= -20 && t->nice <= 20);
 
@@ -804,7 +1030,7 @@ void mlfqs_calculate_recent_cpu(struct thread *t) {
 
 
 void mlfqs_calculate_load_avg(void){
-	int ready_threads = list_size(&ready_list);
+	int ready_threads = ready_cnt;
   
 	if (thread_current () != idle_thread) ready_threads++;
 	
@@ -817,7 +1043,7 @@ void mlfqs_calculate_load_avg(void){
 // ----
 
 void mlfqs_increment_recent_cpu(void){
-	if (thread_current() != idle_thread){
+	if (thread_current() != idle_thread && thread_current() != mlfqs_thread){
 		thread_current()->recent_cpu = ADD_FP_INT(thread_current()->recent_cpu, 1);
 	}
 }
@@ -837,6 +1063,7 @@ void mlfqs_recalculate_priority(void){
 	struct list_elem *e;
 	struct thread *t;
 
+	ASSERT(intr_get_level() == INTR_OFF);
 
 	for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)){
 		
@@ -844,4 +1071,31 @@ void mlfqs_recalculate_priority(void){
 		mlfqs_calculate_priority(t);
 
 	}
-}
\ No newline at end of file
+}
+
+/* Called from the timer interrupt once per second.  Only the
+   running thread's recent_cpu changes between seconds, so the
+   handler recomputes that one priority itself every 4 ticks and
+   leaves the all-threads decay to mlfqs_worker(). */
+void mlfqs_request_recalculation(void){
+	ASSERT(intr_context());
+	sema_up(&mlfqs_sema);
+}
+
+/* Decays recent_cpu and recomputes the priority of every thread,
+   once per mlfqs_request_recalculation().  Ready threads are moved
+   between run queues by thread_change_priority(). */
+static void
+mlfqs_worker (void *aux UNUSED) {
+	enum intr_level old_level;
+
+	mlfqs_thread = thread_current ();
+	for (;;) {
+		sema_down (&mlfqs_sema);
+
+		old_level = intr_disable ();
+		mlfqs_recalculate_recent_cpu ();
+		mlfqs_recalculate_priority ();
+		intr_set_level (old_level);
+	}
+}
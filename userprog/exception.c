@@ -139,9 +139,6 @@ page_fault (struct intr_frame *f) {
 	not_present = (f->error_code & PF_P) == 0;
 	write = (f->error_code & PF_W) != 0;
 	user = (f->error_code & PF_U) != 0;
-	// (P2: Bad) Bad 6 문제들
-	if (user || not_present)
-		sys_exit(-1);
 
 #ifdef VM
 	/* For project 3 and later. */
@@ -149,6 +146,10 @@ page_fault (struct intr_frame *f) {
 		return;
 #endif
 
+	// (P2: Bad) Bad 6 문제들
+	if (user || not_present)
+		sys_exit(-1);
+
 	/* Count page faults. */
 	page_fault_cnt++;
 
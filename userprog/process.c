@@ -10,9 +10,11 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/synch.h" // (P2:syscall) fork
@@ -236,6 +238,9 @@ process_exec (void *f_name) {
 
 	/* We first kill the current context */
 	process_cleanup ();
+#ifdef VM
+	supplemental_page_table_init (&thread_current ()->spt);
+#endif
 
 	/* And then load the binary */
 	success = load (file_name, &_if);
@@ -246,7 +251,10 @@ process_exec (void *f_name) {
 
 
 	//// (P2:args) Passing
-    argument_stack(parse, count, &_if.rsp); // 함수 내부에서 parse와 rsp의 값을 직접 변경하기 위해 주소 전달
+    /* _if is packed, so push through an aligned copy of rsp. */
+    void *rsp = (void *) _if.rsp;
+    argument_stack(parse, count, &rsp); // 함수 내부에서 parse와 rsp의 값을 직접 변경하기 위해 주소 전달
+    _if.rsp = (uintptr_t) rsp;
     _if.R.rdi = count; // 인터럽트 프레임의 RDI 레지스터 필드에 저장
     _if.R.rsi = (char *)_if.rsp + 8; // 인터럽트 프레임의 RSI 레지스터 필드에 저장
 
@@ -569,6 +577,63 @@ validate_segment (const struct Phdr *phdr, struct file *file) {
 	return true;
 }
 
+//// (P2:args) 받은 인자들을 스택에 넣어주기
+// parse = 인자들을 받은 배열, count = 인자의 수, rsp = 스택 포인터
+void argument_stack(char **parse, int count, void **rsp)
+{
+    // 모든 인자 문자열 push
+    for (int i = count - 1; i > -1; i--) // 역순으로 푸쉬
+    {
+        for (int j = strlen(parse[i]); j > -1; j--) //각 문자열을 끝에서부터 한 문자씩 푸시
+        {
+            (*rsp)--;                      // 스택 주소 감소
+            **(char **)rsp = parse[i][j]; // 주소에 문자 저장
+        }
+        parse[i] = *(char **)rsp; //각 인자의 시작 주소를 parse[i]에 저장
+    }
+
+    // 정렬 패딩 push
+    int padding = (uintptr_t) *rsp % 8;
+    for (int i = 0; i < padding; i++)
+    {
+        (*rsp)--;
+        **(uint8_t **)rsp = 0; // rsp 직전까지 값 채움
+    }
+
+    // 인자 문자열 종료 표시인 NULL push
+    (*rsp) -= 8;
+    **(char ***)rsp = 0; // char* 타입의 0 추가
+
+    // 각 인자 주소 push
+    for (int i = count - 1; i > -1; i--) //각 인자 문자열의 주소를 역순으로 푸시
+    {
+        (*rsp) -= 8; // 다음 주소로 이동
+        **(char ***)rsp = parse[i]; // char* 타입의 주소 추가
+    }
+
+    // return address push
+    (*rsp) -= 8;
+    **(void ***)rsp = 0; // void* 타입의 0 추가
+}
+
+//(P2:syscall) To find a child process in the child_list
+struct thread *get_child_process(int pid)
+{
+    struct thread *cur = thread_current();
+    struct list *child_list = &cur->child_list;
+
+	// Check all child_elem whether it is eqaul to the pid. 
+    for (struct list_elem *e = list_begin(child_list); e != list_end(child_list); e = list_next(e))
+    {
+        struct thread *t = list_entry(e, struct thread, child_elem);
+        
+        if (t->tid == pid) //if yes, 
+            return t;
+    }
+    
+    return NULL; // if no, 
+}
+
 #ifndef VM
 /* Codes of this block will be ONLY USED DURING project 2.
  * If you want to implement the function for whole project 2, implement it
@@ -651,64 +716,6 @@ setup_stack (struct intr_frame *if_) {
 }
 
 
-//// (P2:args) 받은 인자들을 스택에 넣어주기
-// parse = 인자들을 받은 배열, count = 인자의 수, rsp = 스택 포인터
-void argument_stack(char **parse, int count, void **rsp)
-{
-    // 모든 인자 문자열 push
-    for (int i = count - 1; i > -1; i--) // 역순으로 푸쉬
-    {
-        for (int j = strlen(parse[i]); j > -1; j--) //각 문자열을 끝에서부터 한 문자씩 푸시
-        {
-            (*rsp)--;                      // 스택 주소 감소
-            **(char **)rsp = parse[i][j]; // 주소에 문자 저장
-        }
-        parse[i] = *(char **)rsp; //각 인자의 시작 주소를 parse[i]에 저장
-    }
-
-    // 정렬 패딩 push
-    int padding = (int)*rsp % 8;
-    for (int i = 0; i < padding; i++)
-    {
-        (*rsp)--;
-        **(uint8_t **)rsp = 0; // rsp 직전까지 값 채움
-    }
-
-    // 인자 문자열 종료 표시인 NULL push
-    (*rsp) -= 8;
-    **(char ***)rsp = 0; // char* 타입의 0 추가
-
-    // 각 인자 주소 push
-    for (int i = count - 1; i > -1; i--) //각 인자 문자열의 주소를 역순으로 푸시
-    {
-        (*rsp) -= 8; // 다음 주소로 이동
-        **(char ***)rsp = parse[i]; // char* 타입의 주소 추가
-    }
-
-    // return address push
-    (*rsp) -= 8;
-    **(void ***)rsp = 0; // void* 타입의 0 추가
-}
-
-//(P2:syscall) To find a child process in the child_list
-struct thread *get_child_process(int pid)
-{
-    struct thread *cur = thread_current();
-    struct list *child_list = &cur->child_list;
-
-	// Check all child_elem whether it is eqaul to the pid. 
-    for (struct list_elem *e = list_begin(child_list); e != list_end(child_list); e = list_next(e))
-    {
-        struct thread *t = list_entry(e, struct thread, child_elem);
-        
-        if (t->tid == pid) //if yes, 
-            return t;
-    }
-    
-    return NULL; // if no, 
-}
-
-
 /* Adds a mapping from user virtual address UPAGE to kernel
  * virtual address KPAGE to the page table.
  * If WRITABLE is true, the user process may modify the page;
@@ -732,13 +739,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -751,6 +751,10 @@ lazy_load_segment (struct page *page, void *aux) {
  * The pages initialized by this function must be writable by the
  * user process if WRITABLE is true, read-only otherwise.
  *
+ * The pages are file pages, loaded when they first fault.  Until
+ * they are written, they may share frames with the same pages of
+ * other processes running the same executable.
+ *
  * Return true if successful, false if a memory allocation error
  * or disk read error occurs. */
 static bool
@@ -767,16 +771,26 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
+		struct file_page *aux = malloc (sizeof *aux);
+		if (aux == NULL)
+			return false;
+		aux->inode = inode_reopen (file_get_inode (file));
+		aux->ofs = ofs;
+		aux->read_bytes = page_read_bytes;
+		aux->shared = false;
+		aux->map_addr = NULL;
+		if (!vm_alloc_page_with_initializer (VM_FILE, upage,
+					writable, NULL, aux)) {
+			inode_close (aux->inode);
+			free (aux);
 			return false;
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += PGSIZE;
 	}
 	return true;
 }
@@ -787,11 +801,11 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	if (vm_alloc_page (VM_ANON, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
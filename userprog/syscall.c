@@ -14,6 +14,10 @@
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include <string.h>
+#ifdef VM
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
@@ -52,6 +56,9 @@ bool sys_remove(const char *file);
 int sys_wait (pid_t pid);
 pid_t sys_fork (const char *thread_name, struct intr_frame *f);
 int sys_exec (const char *cmd_line);
+#ifdef VM
+void *sys_mmap (void *addr, size_t length, int writable, int fd, off_t offset);
+#endif
 
 void
 syscall_init (void) {
@@ -73,6 +80,10 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	char *fn_copy;
 	int siz;
 	
+#ifdef VM
+	// (P3:stack) A page fault taken in the kernel needs the user rsp to grow the stack
+	thread_current ()->user_rsp = f->rsp;
+#endif
 	switch (f->R.rax)
 	{
 	case SYS_HALT:
@@ -117,6 +128,18 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	case SYS_CLOSE:
 		sys_close(f->R.rdi);
 		break;
+#ifdef VM
+	case SYS_MMAP:
+		f->R.rax = (uint64_t) sys_mmap((void *) f->R.rdi, f->R.rsi, f->R.rdx,
+				f->R.r10, f->R.r8);
+		break;
+	case SYS_MUNMAP:
+		do_munmap((void *) f->R.rdi);
+		break;
+	case SYS_MSYNC:
+		do_msync((void *) f->R.rdi);
+		break;
+#endif
 	default:
 		thread_exit();
 		break;
@@ -133,7 +156,12 @@ void check_ptr(const void *ptr)
 	if (!is_user_vaddr(ptr)) sys_exit(-1); // Check whether it is in user stack
 	// is_user_vaddr will call is_kernel_vaddr to check whether it is in user stack
 
+#ifdef VM
+	/* Pages are loaded lazily, so the page table is not enough. */
+	if (ptr == NULL || spt_find_page (&cur->spt, (void *) ptr) == NULL) sys_exit(-1);
+#else
 	if (pml4_get_page(cur->pml4, ptr) == NULL || ptr == NULL ) sys_exit(-1);
+#endif
 }
 // (P2:syscall) Check whether it is correct fd
 bool check_fd(int fd)
@@ -168,6 +196,42 @@ void sys_exit(int status)
 }
 
 
+#ifdef VM
+/* Most bytes of a user buffer that read() and write() pin at
+   once, so that a large buffer cannot pin every user frame. */
+#define PIN_CHUNK (8 * PGSIZE)
+
+/* Reads (if READ) or writes SIZE bytes between FILE and the user
+   BUFFER, keeping at most PIN_CHUNK bytes of BUFFER resident at a
+   time while the file system accesses them.  Returns the number
+   of bytes transferred, or kills the process if BUFFER is not in
+   its address space. */
+static off_t
+file_io_pinned (struct file *file, void *buffer, unsigned size, bool read)
+{
+	off_t done = 0;
+
+	while ((unsigned) done < size) {
+		uint8_t *chunk = (uint8_t *) buffer + done;
+		size_t chunk_size = PIN_CHUNK - pg_ofs (chunk);
+		off_t n;
+
+		if (chunk_size > size - done)
+			chunk_size = size - done;
+		/* A buffer read into must be writable. */
+		if (!vm_pin_buffer (chunk, chunk_size, read))
+			sys_exit(-1);
+		n = read ? file_read (file, chunk, chunk_size)
+			: file_write (file, chunk, chunk_size);
+		vm_unpin_buffer (chunk, chunk_size);
+		done += n;
+		if ((size_t) n < chunk_size)
+			break;
+	}
+	return done;
+}
+#endif
+
 // (P2:syscall) Writes size bytes from buffer to the open file fd
 int sys_write(int fd, const void *buffer, unsigned size)
 {
@@ -184,8 +248,12 @@ int sys_write(int fd, const void *buffer, unsigned size)
 	}
 	else if (check_fd(fd))
 	{
-		
+#ifdef VM
+		/* Keep the buffer resident while the file system reads it. */
+		return file_io_pinned (t->fd_table[fd], (void *) buffer, size, false);
+#else
 		return file_write(t->fd_table[fd], buffer, size); // Writes size bytes from buffer to the open file fd
+#endif
 	}
 	else 
 	{
@@ -262,7 +330,12 @@ int sys_read(int fd, void *buffer, unsigned size)
 			sys_exit(-1);
 		}
 		struct file *target = thread_current()->fd_table[fd];
+#ifdef VM
+		/* Keep the buffer resident while the file system fills it. */
+		off_t bytes_read = file_io_pinned (target, buffer, size, true);
+#else
 		off_t bytes_read = file_read(target, buffer, size);
+#endif
 		return bytes_read;
 	}
 	else
@@ -327,3 +400,13 @@ int sys_exec (const char *cmd_line){
 	if (process_exec(cmd_line_copy) == -1) 
 		sys_exit(-1); 
 }
+
+#ifdef VM
+// (P3:mmap) Maps LENGTH bytes of the file open as FD at ADDR
+void *sys_mmap (void *addr, size_t length, int writable, int fd, off_t offset)
+{
+	if (fd < 2 || !check_fd(fd))
+		return NULL;
+	return do_mmap(addr, length, writable, thread_current()->fd_table[fd], offset);
+}
+#endif
@@ -2,6 +2,39 @@
 
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap space.
+
+   The swap disk is divided into page-sized slots of
+   SECTORS_PER_SLOT sectors, tracked by a bitmap.  Slots are handed
+   out next fit from a cursor, so the pages of one eviction
+   cluster, which vm_evict_frame() swaps out back to back, land in
+   consecutive slots once anon_swap_cluster() has placed the cursor
+   at a free run long enough for them.
+
+   A frame that fork() shares among several pages is written to
+   one slot, which all of them then refer to, and fork() copies a
+   page that is in swap by taking another reference to its slot.
+   A slot is freed once the last page referring to it has been
+   read back or destroyed.
+
+   Each slot also records the page that was written to it, for as
+   long as that page refers to it.  When a page is swapped in,
+   pages of the same process in the slots that follow are read in
+   too, as long as there are free frames to hold them: pages
+   evicted together were often used together. */
+
+/* Sectors per swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most slots read ahead after a swap-in. */
+#define READ_AHEAD 4
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +50,253 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+static struct lock swap_lock;           /* Guards the members below. */
+static struct bitmap *swap_map;         /* Slots in use. */
+static struct page **slot_pages;        /* Page in each slot in use. */
+static unsigned *slot_refs;             /* Pages referring to each slot. */
+static size_t swap_cursor;              /* Next slot to try. */
+
+/* Swap statistics. */
+static unsigned long long swap_out_cnt;
+static unsigned long long swap_in_cnt;
+static unsigned long long read_ahead_cnt;
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+
+	lock_init (&swap_lock);
+	swap_disk = disk_get (1, 1);
+	slot_cnt = swap_disk != NULL ? disk_size (swap_disk) / SECTORS_PER_SLOT : 0;
+	swap_map = bitmap_create (slot_cnt);
+	slot_pages = calloc (slot_cnt, sizeof *slot_pages);
+	slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+	if (swap_map == NULL
+			|| (slot_cnt > 0 && (slot_pages == NULL || slot_refs == NULL)))
+		PANIC ("vm_anon_init: out of memory for %zu swap slots", slot_cnt);
+	swap_cursor = 0;
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva) {
+	/* A new anonymous page starts out zeroed, but a file page
+	   turned anonymous keeps what it holds. */
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		memset (kva, 0, PGSIZE);
+
 	/* Set up the handler */
 	page->operations = &anon_ops;
+	page->anon.slot = BITMAP_ERROR;
+	return true;
+}
 
-	struct anon_page *anon_page = &page->anon;
+/* Moves the slot cursor to the start of a run of CNT free slots,
+   if there is one, so that the next CNT pages swapped out are
+   written to consecutive slots. */
+void
+anon_swap_cluster (size_t cnt) {
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan (swap_map, swap_cursor, cnt, false);
+	if (slot == BITMAP_ERROR)
+		slot = bitmap_scan (swap_map, 0, cnt, false);
+	if (slot != BITMAP_ERROR)
+		swap_cursor = slot;
+	lock_release (&swap_lock);
+}
+
+/* Returns true if a swap slot is free. */
+bool
+anon_swap_available (void) {
+	bool available;
+
+	lock_acquire (&swap_lock);
+	available = bitmap_scan (swap_map, swap_cursor, 1, false) != BITMAP_ERROR
+		|| bitmap_scan (swap_map, 0, 1, false) != BITMAP_ERROR;
+	lock_release (&swap_lock);
+	return available;
+}
+
+/* Allocates a slot for PAGE and returns it, or BITMAP_ERROR if
+   swap is full. */
+static size_t
+slot_alloc (struct page *page) {
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_and_flip (swap_map, swap_cursor, 1, false);
+	if (slot == BITMAP_ERROR)
+		slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+	if (slot != BITMAP_ERROR) {
+		slot_pages[slot] = page;
+		slot_refs[slot] = 1;
+		swap_cursor = slot + 1 < bitmap_size (swap_map) ? slot + 1 : 0;
+	}
+	lock_release (&swap_lock);
+	return slot;
+}
+
+/* Adds a reference to SLOT, which is in use, for another page. */
+static void
+slot_get (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot));
+	slot_refs[slot]++;
+	lock_release (&swap_lock);
+}
+
+/* Drops PAGE's reference to SLOT, and frees SLOT if it was the
+   last. */
+static void
+slot_put (size_t slot, struct page *page) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot));
+	ASSERT (slot_refs[slot] > 0);
+	if (slot_pages[slot] == page)
+		slot_pages[slot] = NULL;
+	if (--slot_refs[slot] == 0)
+		bitmap_reset (swap_map, slot);
+	lock_release (&swap_lock);
+}
+
+/* Reads SLOT into the page at KVA. */
+static void
+slot_read (size_t slot, void *kva) {
+	size_t i;
+
+	for (i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Reads in the pages of the current process that sit in the
+   READ_AHEAD slots after SLOT, while free frames last.  Only our
+   own pages are considered, because no other thread can swap
+   them in or destroy them meanwhile. */
+static void
+read_ahead (size_t slot) {
+	size_t last = slot + READ_AHEAD;
+
+	while (++slot <= last && slot < bitmap_size (swap_map)) {
+		struct page *page;
+		struct frame *frame;
+
+		lock_acquire (&swap_lock);
+		page = slot_pages[slot];
+		lock_release (&swap_lock);
+		if (page == NULL || page->owner != thread_current ())
+			continue;
+
+		/* Waits out an eviction that may still be writing PAGE. */
+		frame = vm_get_free_frame ();
+		if (frame == NULL)
+			break;
+		slot_read (slot, frame->kva);
+		if (!vm_install_frame (page, frame))
+			break;
+		slot_put (slot, page);
+		page->anon.slot = BITMAP_ERROR;
+		vm_unpin_frame (frame);
+		read_ahead_cnt++;
+	}
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = anon_page->slot;
+
+	if (slot == BITMAP_ERROR)
+		return false;
+
+	slot_read (slot, kva);
+	slot_put (slot, page);
+	anon_page->slot = BITMAP_ERROR;
+	swap_in_cnt++;
+
+	read_ahead (slot);
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Returns the slot that another page sharing PAGE's frame was
+   just swapped out to, or BITMAP_ERROR if there is none.  The
+   pages of a frame being evicted are swapped out one after
+   another, and those of any other frame are never in swap, so a
+   slot found here holds the frame's contents.  FRAME_LOCK must be
+   held. */
+static size_t
+frame_swap_slot (struct page *page) {
+	struct list *pages = &page->frame->pages;
+	struct list_elem *e;
+
+	for (e = list_begin (pages); e != list_end (pages); e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, frame_elem);
+
+		if (p != page && p->operations == &anon_ops
+				&& p->anon.slot != BITMAP_ERROR)
+			return p->anon.slot;
+	}
+	return BITMAP_ERROR;
+}
+
+/* Swap out the page by writing contents to the swap disk.  A page
+   whose frame was already written out for another page refers to
+   the same slot instead. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = frame_swap_slot (page);
+	size_t i;
+
+	if (slot != BITMAP_ERROR) {
+		slot_get (slot);
+		anon_page->slot = slot;
+		return true;
+	}
+
+	slot = slot_alloc (page);
+	if (slot == BITMAP_ERROR)
+		return false;
+
+	for (i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(uint8_t *) page->frame->kva + i * DISK_SECTOR_SIZE);
+	anon_page->slot = slot;
+	swap_out_cnt++;
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot != BITMAP_ERROR) {
+		slot_put (anon_page->slot, page);
+		anon_page->slot = BITMAP_ERROR;
+	}
+}
+
+/* Makes PAGE, fork()'s copy of an anonymous page that is in
+   swap, refer to the same slot as the original. */
+void
+anon_copy_swapped (struct page *page) {
+	ASSERT (page->operations == &anon_ops);
+	ASSERT (page->frame == NULL);
+
+	if (page->anon.slot != BITMAP_ERROR)
+		slot_get (page->anon.slot);
+}
+
+/* Prints swap statistics. */
+void
+vm_anon_print_stats (void) {
+	printf ("Swap: %zu slots, %llu pages out, %llu in, %llu read ahead\n",
+			bitmap_size (swap_map), swap_out_cnt, swap_in_cnt,
+			read_ahead_cnt);
 }
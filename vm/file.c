@@ -1,6 +1,12 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <round.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -19,40 +25,158 @@ void
 vm_file_init (void) {
 }
 
-/* Initialize the file backed page */
+/* Initialize the file backed page
+ *
+ * Takes over the struct file_page that PAGE had as its aux, and
+ * reads the page into KVA, unless KVA is a null pointer because
+ * the page is being mapped to a frame that already holds it. */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva) {
+	struct file_page *aux = page->uninit.aux;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
-
-	struct file_page *file_page = &page->file;
+	page->file = *aux;
+	free (aux);
+	return kva == NULL || file_backed_swap_in (page, kva);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+	off_t read_bytes = file_page->read_bytes;
+
+	if (inode_read_at (file_page->inode, kva, read_bytes, file_page->ofs)
+			!= read_bytes)
+		return false;
+	memset ((uint8_t *) kva + read_bytes, 0, PGSIZE - read_bytes);
+	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.
+ * Nothing needs writing here.  A private file page always matches
+ * the file, since the first write to it turns it into an anonymous
+ * page (see vm_handle_wp()), and vm_evict_frame() writes back the
+ * frame of a shared mapping once for all the pages that map it. */
 static bool
-file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+file_backed_swap_out (struct page *page UNUSED) {
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	inode_close (file_page->inode);
+	file_page->inode = NULL;
 }
 
-/* Do the mmap */
+/* Writes the contents of FILE_PAGE, from the frame at KVA, back
+ * to its file. */
+void
+file_backed_write_back (const struct file_page *file_page, const void *kva) {
+	inode_write_at (file_page->inode, kva, file_page->read_bytes,
+			file_page->ofs);
+}
+
+/* Do the mmap
+ *
+ * Maps LENGTH bytes of FILE, from OFFSET on, at ADDR in the
+ * current process, writable if WRITABLE, and returns ADDR, or a
+ * null pointer on failure.  Bytes past the end of the file read as
+ * zero and are not written back.  The mapping is shared: frames
+ * are shared with other mappings of the same pages of the file,
+ * and written back to it by do_msync(), do_munmap() and exit. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	off_t file_len = file_length (file);
+	uint8_t *upage = addr;
+	uint8_t *end;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+			|| length == 0 || length > (uint64_t) KERN_BASE - (uint64_t) addr
+			|| offset < 0 || pg_ofs (offset) != 0 || file_len == 0)
+		return NULL;
+	end = upage + ROUND_UP (length, PGSIZE);
+	if (spt_find_range (spt, upage, end) != NULL
+			|| vm_stack_reserved (upage, end))
+		return NULL;
+
+	for (; upage < end; upage += PGSIZE, offset += PGSIZE) {
+		struct file_page *aux = malloc (sizeof *aux);
+
+		if (aux == NULL)
+			goto fail;
+		aux->inode = inode_reopen (file_get_inode (file));
+		aux->ofs = offset;
+		aux->read_bytes = offset < file_len ? file_len - offset : 0;
+		if (aux->read_bytes > PGSIZE)
+			aux->read_bytes = PGSIZE;
+		aux->shared = true;
+		aux->map_addr = addr;
+		if (!vm_alloc_page_with_initializer (VM_FILE, upage, writable,
+					NULL, aux)) {
+			inode_close (aux->inode);
+			free (aux);
+			goto fail;
+		}
+	}
+	return addr;
+
+fail:
+	do_munmap (addr);
+	return NULL;
+}
+
+/* Returns the end of the mapping that starts at ADDR in SPT, or a
+ * null pointer if no mapping starts there. */
+static void *
+mapping_end (struct supplemental_page_table *spt, void *addr) {
+	struct page *page = spt_find_page (spt, addr);
+	void *end = NULL;
+
+	for (; page != NULL; page = spt_next_page (spt, page)) {
+		const struct file_page *source = page_file_source (page);
+		if (source == NULL || !source->shared || source->map_addr != addr)
+			break;
+		end = (uint8_t *) page->va + PGSIZE;
+	}
+	return end;
 }
 
-/* Do the munmap */
+/* Do the munmap
+ *
+ * Writes back and removes the mapping that starts at ADDR, if
+ * there is one. */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = mapping_end (spt, addr);
+	struct page *page;
+
+	if (end == NULL)
+		return;
+	spt_write_back (spt, addr, end);
+	page = spt_find_page (spt, addr);
+	while (page != NULL && page->va < end) {
+		struct page *next = spt_next_page (spt, page);
+		spt_remove_page (spt, page);
+		page = next;
+	}
+}
+
+/* Writes back the dirty pages of the mapping that starts at ADDR,
+ * if there is one. */
+void
+do_msync (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = mapping_end (spt, addr);
+
+	if (end != NULL)
+		spt_write_back (spt, addr, end);
 }
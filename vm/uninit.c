@@ -10,6 +10,8 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
 
 static bool uninit_initialize (struct page *page, void *kva);
 static void uninit_destroy (struct page *page);
@@ -62,7 +64,12 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+	struct uninit_page *uninit = &page->uninit;
+
+	/* AUX is malloc()'d by whoever created the page, and is the
+	 * initializer's to free once it runs.  A file page's aux also
+	 * holds a reference to its inode. */
+	if (VM_TYPE (uninit->type) == VM_FILE)
+		inode_close (((struct file_page *) uninit->aux)->inode);
+	free (uninit->aux);
 }
@@ -1,9 +1,93 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Caches for struct page and struct frame. */
+static struct kmem_cache *page_cache;
+static struct kmem_cache *frame_cache;
+
+/* Frame table: every frame from the user pool that holds a page,
+   in the order the clock hand visits them.  FRAME_LOCK guards the
+   table, the clock hand, the free frame list and the `page',
+   `pages' and `pin_cnt' members of frames, and is held for the
+   whole of an eviction, so a fault on a page being evicted waits
+   until it is out.
+
+   After fork(), a frame may be shared copy-on-write by pages of
+   several processes, all mapped read-only; `page' is then any one
+   of them.  The first write to a shared frame copies it.
+
+   Frames that hold a page of a file just as it is in the file,
+   such as the code of a running program, are also indexed by
+   their `source' in FILE_FRAMES, also guarded by FRAME_LOCK.  A
+   file page that faults in while its frame is there is mapped to
+   it read-only instead of being read again, so that processes
+   running the same program share its code and the unmodified
+   pages of its data.  The frames of shared file mappings are
+   indexed the same way, but are mapped writable if the mapping
+   is, and are written back to the file when they are dirty.
+
+   Once every page of an aligned 2 MB region of anonymous memory
+   is resident, the region is moved into one physically contiguous
+   block and mapped as a huge page (see vm_try_promote()).  Its
+   frames stay in the frame table, one per small page, and any
+   change to the mapping of one of them, such as evicting it or
+   sharing it with a child, first splits the huge page up again. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static struct list free_frames;
+static struct hash file_frames;
+static struct lock frame_lock;
+
+/* Most pages evicted at once.  Evicting several pages together
+   lets the swap code write them to consecutive slots, and the
+   frames not needed right away are kept in FREE_FRAMES for the
+   faults that follow. */
+#define EVICT_CLUSTER 4
+
+/* Eviction statistics. */
+static unsigned long long evict_cnt;        /* Pages evicted. */
+static unsigned long long evict_dirty_cnt;  /* ...that were dirty. */
+static unsigned long long second_chance_cnt; /* Accessed bits cleared. */
+static unsigned long long cow_share_cnt;    /* Pages shared by fork(). */
+static unsigned long long cow_copy_cnt;     /* ...copied on write. */
+static unsigned long long file_share_cnt;   /* File pages found cached. */
+static unsigned long long fault_around_cnt; /* Pages mapped around faults. */
+static unsigned long long prefetch_cnt;     /* ...that had to be read. */
+static unsigned long long write_back_cnt;   /* Mapped pages written back. */
+static unsigned long long huge_promote_cnt; /* Huge pages made. */
+static unsigned long long huge_demote_cnt;  /* ...split up again. */
+static unsigned long long stack_grow_cnt;   /* Stack growth faults. */
+static unsigned long long stack_ahead_cnt;  /* Stack pages mapped ahead. */
+
+/* Fault-around block, in pages, and most pages read ahead of a
+   run of sequential faults.  See vm_fault_around(). */
+#define FAULT_AROUND 8
+#define PREFETCH_MAX 64
+
+/* Default user stack limit, in pages: 1 MB.  Settable with the
+   -sl kernel command line option. */
+size_t stack_page_limit = 256;
+
+/* Most pages mapped below the faulting one when the stack grows,
+   so that a deep recursion faults once every STACK_BATCH pages
+   rather than on every page.  See vm_stack_growth(). */
+#define STACK_BATCH 8
+
+static uint64_t file_frame_hash (const struct hash_elem *, void *);
+static bool file_frame_less (const struct hash_elem *,
+		const struct hash_elem *, void *);
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +99,13 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	page_cache = kmem_cache_create ("page", sizeof (struct page), NULL);
+	frame_cache = kmem_cache_create ("frame", sizeof (struct frame), NULL);
+	list_init (&frame_table);
+	clock_hand = list_end (&frame_table);
+	list_init (&free_frames);
+	hash_init (&file_frames, file_frame_hash, file_frame_less, NULL);
+	lock_init (&frame_lock);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,9 +123,22 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (bool swap_full);
 static bool vm_do_claim_page (struct page *page);
+static bool vm_claim_pinned (struct page *page);
 static struct frame *vm_evict_frame (void);
+static void vm_link_frame (struct page *page, struct frame *frame);
+static bool vm_handle_wp (struct page *page);
+static bool vm_claim_for (struct page *page, bool write);
+static bool vm_share_file_frame (struct page *page,
+		const struct file_page *source);
+static bool vm_map_file_frame (struct page *page);
+static bool vm_fill_frame (struct page *page, struct frame *frame,
+		bool shared);
+static void vm_try_promote (struct supplemental_page_table *spt,
+		struct page *page);
+static void vm_fault_around (struct supplemental_page_table *spt,
+		struct page *page);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,94 +153,768 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = kmem_cache_alloc (page_cache);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->owner = thread_current ();
+		page->writable = writable;
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			kmem_cache_free (page_cache, page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
+/* Returns a hash value for the page that E is in. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *p = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&p->va, sizeof p->va);
+}
+
+/* Returns true if the page that A is in precedes the one B is
+   in. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct page, spt_elem)->va
+		< hash_entry (b, struct page, spt_elem)->va;
+}
+
+/* Same as page_less(), for the ordered index. */
+static bool
+page_range_less (const struct tree_elem *a, const struct tree_elem *b,
+		void *aux UNUSED) {
+	return tree_entry (a, struct page, range_elem)->va
+		< tree_entry (b, struct page, range_elem)->va;
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page p;
+	struct hash_elem *e;
 
-	return page;
+	p.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &p.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
+
+	if (hash_insert (&spt->pages, &page->spt_elem) != NULL)
+		return false;
+	tree_insert (&spt->ranges, &page->range_elem);
+	return true;
+}
+
+/* Adds PAGE to the pages mapped to FRAME.  FRAME_LOCK must be
+   held. */
+static void
+frame_add_page (struct frame *frame, struct page *page) {
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->page = list_entry (list_front (&frame->pages), struct page,
+			frame_elem);
+	page->frame = frame;
+}
+
+/* Removes PAGE from the pages mapped to FRAME and returns true if
+   it was the last one.  Leaves PAGE's `frame' alone.  FRAME_LOCK
+   must be held. */
+static bool
+frame_remove_page (struct frame *frame, struct page *page) {
+	list_remove (&page->frame_elem);
+	if (list_empty (&frame->pages)) {
+		frame->page = NULL;
+		return true;
+	}
+	frame->page = list_entry (list_front (&frame->pages), struct page,
+			frame_elem);
+	return false;
+}
+
+/* Returns true if FRAME is mapped by more than one page.
+   FRAME_LOCK must be held. */
+static bool
+frame_is_shared (struct frame *frame) {
+	return list_front (&frame->pages) != list_back (&frame->pages);
+}
+
+/* Returns a hash value for the frame that E is in. */
+static uint64_t
+file_frame_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *f = hash_entry (e, struct frame, file_elem);
+	return hash_bytes (&f->source.inode, sizeof f->source.inode)
+		^ hash_int (f->source.ofs) ^ hash_int (f->source.read_bytes << 20);
+}
+
+/* Returns true if the frame that A is in precedes the one B is
+   in. */
+static bool
+file_frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct file_page *a = &hash_entry (a_, struct frame, file_elem)->source;
+	const struct file_page *b = &hash_entry (b_, struct frame, file_elem)->source;
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	if (a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	if (a->read_bytes != b->read_bytes)
+		return a->read_bytes < b->read_bytes;
+	return a->shared < b->shared;
+}
+
+/* Returns the description of the file contents PAGE holds or is
+   to be loaded with, or a null pointer if it is not a file page. */
+const struct file_page *
+page_file_source (struct page *page) {
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_FILE:
+			return &page->file;
+		case VM_UNINIT:
+			if (VM_TYPE (page->uninit.type) == VM_FILE)
+				return page->uninit.aux;
+			return NULL;
+		default:
+			return NULL;
+	}
+}
+
+/* Returns the cached frame that holds SOURCE, or a null pointer
+   if there is none.  FRAME_LOCK must be held. */
+static struct frame *
+file_frame_find (const struct file_page *source) {
+	struct frame key;
+	struct hash_elem *e;
+
+	key.source = *source;
+	e = hash_find (&file_frames, &key.file_elem);
+	return e != NULL ? hash_entry (e, struct frame, file_elem) : NULL;
+}
+
+/* Takes FRAME out of the file frame cache, if it is there.
+   FRAME_LOCK must be held. */
+static void
+file_frame_forget (struct frame *frame) {
+	if (frame->source.inode != NULL) {
+		hash_delete (&file_frames, &frame->file_elem);
+		frame->source.inode = NULL;
+	}
+}
+
+/* Removes FRAME from the frame table.  FRAME_LOCK must be held. */
+static void
+frame_table_remove (struct frame *frame) {
+	file_frame_forget (frame);
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+}
+
+/* Turns PAGE, which holds the contents at KVA, into an anonymous
+   page if it is a file page, because it is about to be written
+   and will no longer match the file. */
+static void
+page_make_anon (struct page *page, void *kva) {
+	if (VM_TYPE (page->operations->type) == VM_FILE) {
+		destroy (page);
+		anon_initializer (page, VM_ANON, kva);
+	}
+}
+
+/* Returns true if PAGE belongs to a shared file mapping, whose
+   writes go to the file. */
+static bool
+page_is_shared_file (struct page *page) {
+	const struct file_page *source = page_file_source (page);
+	return source != NULL && source->shared;
+}
+
+/* Returns true if FRAME has been written since it was last
+   cleaned, and marks it clean.  FRAME_LOCK must be held. */
+static bool
+frame_test_and_clean (struct frame *frame) {
+	bool dirty = frame->dirty;
+	struct list_elem *e;
+
+	frame->dirty = false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (pml4_is_dirty (page->owner->pml4, page->va)) {
+			pml4_set_dirty (page->owner->pml4, page->va, false);
+			dirty = true;
+		}
+	}
+	return dirty;
+}
+
+/* Splits the huge page that maps PAGE, if there is one, into
+   small pages, so that PAGE's mapping can be changed on its own.
+   FRAME_LOCK must be held. */
+static void
+page_demote (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+
+	if (!pml4_is_huge (pml4, page->va))
+		return;
+	pml4_demote_page (pml4, page->va);
+	huge_demote_cnt++;
+}
+
+/* Unmaps PAGE from its owner's page table and detaches it from
+   its frame, if it has one.  The caller must hold a pin on the
+   frame, which is released; the frame itself is freed once no
+   page maps it. */
+static void
+vm_free_frame (struct page *page) {
+	struct frame *frame;
+	bool last = false;
+
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame != NULL) {
+		ASSERT (frame->pin_cnt > 0);
+		page_demote (page);
+		last = frame_remove_page (frame, page);
+		if (last)
+			frame_table_remove (frame);
+		else
+			frame->pin_cnt--;
+		page->frame = NULL;
+	}
+	lock_release (&frame_lock);
 
-	return succ;
+	if (frame == NULL)
+		return;
+	pml4_clear_page (page->owner->pml4, page->va);
+	if (last) {
+		palloc_free_page (frame->kva);
+		kmem_cache_free (frame_cache, frame);
+	}
 }
 
+/* Destroys PAGE and frees it along with its frame.  The frame is
+   pinned first, so that it cannot be evicted while destroy() is,
+   for example, writing it back; if it is being evicted right now,
+   this waits until it is out.
+
+   If PAGE is the last page of a shared file mapping to leave its
+   frame, the frame is written back if dirty; otherwise PAGE's
+   dirty bit is passed on to the frame. */
+static void
+vm_release_page (struct page *page) {
+	struct frame *frame;
+	bool write = false;
+
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame != NULL) {
+		frame->pin_cnt++;
+		if (page_is_shared_file (page)) {
+			if (frame_is_shared (frame))
+				frame->dirty |= pml4_is_dirty (page->owner->pml4, page->va);
+			else
+				write = frame_test_and_clean (frame);
+		}
+	}
+	lock_release (&frame_lock);
+
+	if (write)
+		file_backed_write_back (&page->file, frame->kva);
+	destroy (page);
+	vm_free_frame (page);
+	kmem_cache_free (page_cache, page);
+}
+
+/* Removes PAGE from SPT and frees it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	vm_dealloc_page (page);
-	return true;
+	hash_delete (&spt->pages, &page->spt_elem);
+	tree_delete (&spt->ranges, &page->range_elem);
+	vm_release_page (page);
+}
+
+/* Returns the lowest page in SPT at or above START and below END,
+   or a null pointer if there is none.  An address range is free
+   exactly when this returns a null pointer. */
+struct page *
+spt_find_range (struct supplemental_page_table *spt, void *start, void *end) {
+	struct page p = { .va = start };
+	struct tree_elem *e;
+	struct page *page;
+
+	e = tree_ceil (&spt->ranges, &p.range_elem);
+	if (e == NULL)
+		return NULL;
+	page = tree_entry (e, struct page, range_elem);
+	return page->va < end ? page : NULL;
+}
+
+/* Returns the page in SPT just above PAGE, which need not be in
+   SPT itself, or a null pointer if there is none. */
+struct page *
+spt_next_page (struct supplemental_page_table *spt, struct page *page) {
+	struct tree_elem *e = tree_next (&spt->ranges, &page->range_elem);
+	return e != NULL ? tree_entry (e, struct page, range_elem) : NULL;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Returns the frame under the clock hand and advances the hand,
+   wrapping around the end of the frame table. */
 static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+clock_advance (void) {
+	if (clock_hand == list_end (&frame_table))
+		clock_hand = list_begin (&frame_table);
+	struct frame *frame = list_entry (clock_hand, struct frame, elem);
+	clock_hand = list_next (clock_hand);
+	return frame;
+}
+
+/* Returns true if any page mapped to FRAME has been accessed
+   since the last call, clearing their accessed bits. */
+static bool
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
 
-	return victim;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_accessed (pml4, page->va)) {
+			/* The frames of a huge page share one accessed bit,
+			   which is cleared only at the first of them, so that
+			   the rest still get their second chance. */
+			if (page->va == hpg_round_down (page->va)
+					|| !pml4_is_huge (pml4, page->va))
+				pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Returns true if evicting FRAME takes a swap slot, because an
+   anonymous page is mapped to it. */
+static bool
+frame_needs_swap (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (VM_TYPE (page->operations->type) == VM_ANON)
+			return true;
+	}
+	return false;
+}
+
+/* Returns true if any page mapped to FRAME has been written. */
+static bool
+frame_is_dirty (struct frame *frame) {
+	struct list_elem *e;
+
+	if (frame->dirty)
+		return true;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (pml4_is_dirty (page->owner->pml4, page->va))
+			return true;
+	}
+	return false;
+}
+
+/* Get the struct frame, that will be evicted.
+ *
+ * The clock hand gives each frame whose page has been accessed a
+ * second chance, clearing its accessed bit as it passes.  During
+ * the first sweep it also passes over dirty pages, which cost a
+ * write to evict, remembering the first one; if the sweep finds no
+ * clean page, that one is taken.  Pinned frames are never taken,
+ * and neither are frames that need a swap slot if SWAP_FULL.
+ * Returns a null pointer if no frame can be taken.  FRAME_LOCK
+ * must be held. */
+static struct frame *
+vm_get_victim (bool swap_full) {
+	size_t frame_cnt = list_size (&frame_table);
+	struct frame *dirty = NULL;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (i = 0; i < 2 * frame_cnt; i++) {
+		struct frame *frame;
+
+		if (i == frame_cnt && dirty != NULL)
+			return dirty;
+
+		frame = clock_advance ();
+		if (frame->pin_cnt > 0 || frame->page == NULL
+				|| (swap_full && frame_needs_swap (frame)))
+			continue;
+
+		if (frame_test_and_clear_accessed (frame))
+			second_chance_cnt++;
+		else if (!frame_is_dirty (frame))
+			return frame;
+		else if (dirty == NULL)
+			dirty = frame;
+	}
+	return dirty;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Returns NULL if no frame can be evicted, because every frame is
+ * pinned or needs a swap slot while swap is full.
+ *
+ * Up to EVICT_CLUSTER frames are evicted in one go; the first is
+ * returned and the rest go on the free frame list.  Every page
+ * mapped to a frame is unmapped before it is swapped out, so that
+ * its owner cannot change it during the write; the dirty bit
+ * survives in the cleared PTE for swap_out() to see.  Each page
+ * that shares a frame is swapped out in turn, but the frame is
+ * written to swap only once, to a slot that all of its anonymous
+ * pages share.  The frame comes back pinned and out of the frame
+ * table until it is reused. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *first = NULL;
+	size_t i;
+
+	lock_acquire (&frame_lock);
+	anon_swap_cluster (EVICT_CLUSTER);
+	for (i = 0; i < EVICT_CLUSTER; i++) {
+		/* Anonymous pages are unmapped only once a slot is sure to
+		   be there for them.  Only eviction takes slots, and only
+		   under FRAME_LOCK, so one free now stays free. */
+		struct frame *victim = vm_get_victim (!anon_swap_available ());
+		struct list_elem *e;
 
-	return NULL;
+		if (victim == NULL)
+			break;
+		/* Only a frame mapped by a single page can be in a huge
+		   page. */
+		page_demote (victim->page);
+		victim->pin_cnt = 1;
+		for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+				e = list_next (e)) {
+			struct page *page = list_entry (e, struct page, frame_elem);
+			pml4_clear_page (page->owner->pml4, page->va);
+		}
+		if (frame_is_dirty (victim))
+			evict_dirty_cnt++;
+		if (victim->source.inode != NULL && victim->source.shared
+				&& frame_test_and_clean (victim))
+			file_backed_write_back (&victim->source, victim->kva);
+		for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+				e = list_next (e)) {
+			struct page *page = list_entry (e, struct page, frame_elem);
+			if (!swap_out (page))
+				NOT_REACHED ();
+			page->frame = NULL;
+		}
+		list_init (&victim->pages);
+		victim->page = NULL;
+		evict_cnt++;
+
+		frame_table_remove (victim);
+		if (first == NULL)
+			first = victim;
+		else
+			list_push_back (&free_frames, &victim->elem);
+	}
+	lock_release (&frame_lock);
+
+	return first;
+}
+
+/* Returns an unused, pinned frame outside the frame table, taken
+   from the free frame list or the user pool, or a null
+   pointer if both are empty.  Never evicts.  Since this acquires
+   FRAME_LOCK, any eviction in progress has finished by the time
+   it returns. */
+struct frame *
+vm_get_free_frame (void) {
+	struct frame *frame = NULL;
+	void *kva;
+
+	lock_acquire (&frame_lock);
+	if (!list_empty (&free_frames))
+		frame = list_entry (list_pop_front (&free_frames), struct frame, elem);
+	lock_release (&frame_lock);
+	if (frame != NULL)
+		return frame;
+
+	frame = kmem_cache_alloc (frame_cache);
+	if (frame == NULL)
+		return NULL;
+	kva = palloc_get_page (PAL_USER);
+	if (kva == NULL) {
+		kmem_cache_free (frame_cache, frame);
+		return NULL;
+	}
+	frame->kva = kva;
+	frame->page = NULL;
+	list_init (&frame->pages);
+	frame->pin_cnt = 1;
+	frame->dirty = false;
+	frame->source.inode = NULL;
+	return frame;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  That is, if the user pool memory is full, this function
+ * evicts a frame to get the available memory space.  Returns a null pointer
+ * if no frame can be evicted, which the caller must treat as running out of
+ * memory. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	struct frame *frame = vm_get_free_frame ();
+
+	if (frame == NULL)
+		frame = vm_evict_frame ();
+	if (frame == NULL)
+		return NULL;
 
-	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
+	ASSERT (frame->pin_cnt == 1);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Links PAGE and FRAME, which must be pinned, and puts FRAME in
+   the frame table just behind the clock hand. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_link_frame (struct page *page, struct frame *frame) {
+	ASSERT (frame->pin_cnt > 0);
+	ASSERT (frame->page == NULL);
+
+	lock_acquire (&frame_lock);
+	frame_add_page (frame, page);
+	list_insert (clock_hand, &frame->elem);
+	lock_release (&frame_lock);
+}
+
+/* Maps PAGE, whose contents the caller has already read into
+   FRAME, a frame obtained from vm_get_free_frame().  The frame
+   stays pinned until the caller passes it to vm_unpin_frame().
+   On failure, frees FRAME and returns false. */
+bool
+vm_install_frame (struct page *page, struct frame *frame) {
+	vm_link_frame (page, frame);
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		vm_free_frame (page);
+		return false;
+	}
+	return true;
+}
+
+/* Releases a pin on FRAME. */
+void
+vm_unpin_frame (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	ASSERT (frame->pin_cnt > 0);
+	frame->pin_cnt--;
+	lock_release (&frame_lock);
+}
+
+/* Returns the lowest address the stack may grow down to.  The
+   page just below it is the guard page, which is kept unmapped,
+   so that a stack overflow faults rather than running into
+   whatever lies below. */
+static uint8_t *
+stack_floor (void) {
+	size_t limit = stack_page_limit;
+
+	if (limit > pg_no (USER_STACK))
+		limit = pg_no (USER_STACK);
+	return (uint8_t *) USER_STACK - limit * PGSIZE + PGSIZE;
+}
+
+/* Returns true if the range from START to END overlaps the range
+   the stack may grow into or its guard page, where nothing else
+   may be mapped. */
+bool
+vm_stack_reserved (const void *start, const void *end) {
+	return (uint8_t *) start < (uint8_t *) USER_STACK
+		&& (uint8_t *) end > stack_floor () - PGSIZE;
 }
 
-/* Handle the fault on write_protected page */
+/* Returns true if an access to ADDR, which is not mapped, with
+   the user stack pointer at RSP, is to be met by growing the
+   stack.  PUSH checks access permissions before it moves the
+   stack pointer, so it may fault 8 bytes below RSP. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+is_stack_access (const void *addr, uint64_t rsp) {
+	return (uint8_t *) addr >= stack_floor ()
+		&& (uint8_t *) addr < (uint8_t *) USER_STACK
+		&& (uint64_t) addr + 8 >= rsp;
+}
+
+/* Growing the stack.
+ *
+ * Adds anonymous pages from ADDR up to the bottom of the stack,
+ * which a large stack frame may have skipped over, and up to
+ * STACK_BATCH pages below ADDR, where the stack is likely to grow
+ * next, never going below the floor.  All but ADDR's own page,
+ * which is left for the caller to claim, are made resident right
+ * away while there are free frames.  Returns false if ADDR's page
+ * could not be added. */
+static bool
+vm_stack_growth (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *fault = pg_round_down (addr);
+	uint8_t *top = spt->stack_bottom;
+	uint8_t *low, *va;
+
+	if (fault >= top)
+		return false;
+	low = (size_t) (fault - stack_floor ()) > STACK_BATCH * PGSIZE
+		? fault - STACK_BATCH * PGSIZE : stack_floor ();
+	for (va = top - PGSIZE; va >= low; va -= PGSIZE) {
+		if (!vm_alloc_page (VM_ANON, va, true)) {
+			if (va >= fault)
+				return false;
+			break;
+		}
+		spt->stack_bottom = va;
+	}
+	stack_grow_cnt++;
+
+	for (va = top - PGSIZE; va >= spt->stack_bottom; va -= PGSIZE) {
+		struct frame *frame;
+
+		if (va == fault)
+			continue;
+		frame = vm_get_free_frame ();
+		if (frame == NULL || !vm_fill_frame (spt_find_page (spt, va), frame,
+					false))
+			break;
+		vm_unpin_frame (frame);
+		stack_ahead_cnt++;
+	}
+	return true;
+}
+
+/* Handle the fault on write_protected page
+ *
+ * PAGE is writable but mapped read-only, because fork() or the
+ * file frame cache shares its frame.  If no other page maps the
+ * frame any more, the mapping is just made writable; otherwise
+ * PAGE gets a copy of its own.  Either way, a file page becomes
+ * anonymous.  Also returns true if PAGE was evicted meanwhile,
+ * since retrying the access then faults it back in.  Returns false
+ * if there is no frame to copy into. */
+static bool
+vm_handle_wp (struct page *page) {
+	struct frame *frame, *copy;
+	bool last;
+
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame != NULL && page_is_shared_file (page)) {
+		pml4_set_writable (page->owner->pml4, page->va, true);
+		lock_release (&frame_lock);
+		return true;
+	}
+	if (frame == NULL || !frame_is_shared (frame)) {
+		if (frame != NULL) {
+			file_frame_forget (frame);
+			page_make_anon (page, frame->kva);
+			pml4_set_writable (page->owner->pml4, page->va, true);
+		}
+		lock_release (&frame_lock);
+		return true;
+	}
+	frame->pin_cnt++;
+	lock_release (&frame_lock);
+
+	copy = vm_get_frame ();
+	if (copy == NULL) {
+		vm_unpin_frame (frame);
+		return false;
+	}
+	memcpy (copy->kva, frame->kva, PGSIZE);
+	pml4_clear_page (page->owner->pml4, page->va);
+
+	lock_acquire (&frame_lock);
+	last = frame_remove_page (frame, page);
+	if (last)
+		frame_table_remove (frame);
+	else
+		frame->pin_cnt--;
+	page->frame = NULL;
+	lock_release (&frame_lock);
+	if (last) {
+		palloc_free_page (frame->kva);
+		kmem_cache_free (frame_cache, frame);
+	}
+
+	cow_copy_cnt++;
+	page_make_anon (page, copy->kva);
+	if (!vm_install_frame (page, copy))
+		return false;
+	vm_unpin_frame (copy);
+	return true;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
 
-	return vm_do_claim_page (page);
+	if (addr == NULL || is_kernel_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (page == NULL) {
+		/* A fault in the kernel comes with the kernel's rsp, so
+		   use the one saved when the system call came in. */
+		uint64_t rsp = user ? f->rsp : thread_current ()->user_rsp;
+
+		if (!is_stack_access (addr, rsp) || !vm_stack_growth (addr))
+			return false;
+		page = spt_find_page (spt, addr);
+	}
+	if (write && !page->writable)
+		return false;
+	if (!not_present)
+		return write && vm_handle_wp (page);
+	if (!vm_claim_for (page, write))
+		return false;
+	vm_unpin_frame (page->frame);
+	if (VM_TYPE (page->operations->type) == VM_FILE)
+		vm_fault_around (spt, page);
+	else if (VM_TYPE (page->operations->type) == VM_ANON)
+		vm_try_promote (spt, page);
+	return true;
 }
 
 /* Free the page.
@@ -145,46 +922,636 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 void
 vm_dealloc_page (struct page *page) {
 	destroy (page);
-	free (page);
+	kmem_cache_free (page_cache, page);
 }
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	if (!vm_claim_pinned (page))
+		return false;
+	vm_unpin_frame (page->frame);
+	return true;
+}
+
+/* Claims PAGE like vm_do_claim_page(), but leaves its frame
+   pinned.  The frame stays pinned while the page is read in, so
+   that it cannot be evicted half-filled. */
+static bool
+vm_claim_pinned (struct page *page) {
+	return vm_claim_for (page, false);
+}
+
+/* Claims PAGE like vm_claim_pinned(), for an access that writes
+   to it if WRITE.
+
+   A file page that is not about to be written is mapped to the
+   cached frame that holds it if there is one, or else read and
+   its frame cached, read-only either way.  One about to be
+   written is read into a frame of its own and made anonymous at
+   once, sparing a second fault.  Pages of shared file mappings
+   always use the cached frame, writable if the mapping is. */
+static bool
+vm_claim_for (struct page *page, bool write) {
+	const struct file_page *source = page_file_source (page);
+	bool cache = source != NULL && (source->shared || !write);
+	struct frame *frame;
+
+	if (cache && vm_share_file_frame (page, source))
+		return vm_map_file_frame (page);
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+	return vm_fill_frame (page, frame, cache);
+}
+
+/* Maps PAGE, a file page whose contents SOURCE describes, to the
+   cached frame that holds them, and returns true with the frame
+   pinned; vm_map_file_frame() must follow.  Returns false if no
+   frame holds them. */
+static bool
+vm_share_file_frame (struct page *page, const struct file_page *source) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame = file_frame_find (source);
+	if (frame != NULL) {
+		frame->pin_cnt++;
+		frame_add_page (frame, page);
+	}
+	lock_release (&frame_lock);
+
+	if (frame != NULL)
+		file_share_cnt++;
+	return frame != NULL;
+}
+
+/* Completes vm_share_file_frame() by initializing PAGE, if need
+   be, and mapping it, read-only unless it belongs to a writable
+   shared mapping. */
+static bool
+vm_map_file_frame (struct page *page) {
+	if ((VM_TYPE (page->operations->type) == VM_UNINIT
+				&& !swap_in (page, NULL))
+			|| !pml4_set_page (page->owner->pml4, page->va,
+				page->frame->kva, page->writable && page->file.shared)) {
+		vm_free_frame (page);
+		return false;
+	}
+	return true;
+}
+
+/* Reads PAGE into FRAME, a frame obtained pinned from
+   vm_get_frame() or vm_get_free_frame(), and maps it.  If CACHE,
+   PAGE must be a file page; it is mapped like vm_map_file_frame()
+   does and FRAME is cached.  If another frame was cached with the
+   same contents meanwhile, a private page keeps FRAME uncached,
+   but a page of a shared mapping, which must see the same frame
+   as every other, drops FRAME for that one.  Otherwise a file
+   page becomes anonymous.  On failure, frees FRAME. */
+static bool
+vm_fill_frame (struct page *page, struct frame *frame, bool cache) {
+	bool file = page_file_source (page) != NULL;
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	vm_link_frame (page, frame);
+
+	if (!swap_in (page, frame->kva))
+		goto fail;
+	if (cache) {
+		bool raced;
+
+		lock_acquire (&frame_lock);
+		raced = file_frame_find (&page->file) != NULL;
+		if (!raced) {
+			frame->source = page->file;
+			hash_insert (&file_frames, &frame->file_elem);
+		}
+		lock_release (&frame_lock);
+
+		if (raced && page->file.shared) {
+			vm_free_frame (page);
+			return vm_share_file_frame (page, &page->file)
+				&& vm_map_file_frame (page);
+		}
+	} else if (file)
+		page_make_anon (page, frame->kva);
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable && (!cache || page->file.shared)))
+		goto fail;
+	return true;
+
+fail:
+	vm_free_frame (page);
+	return false;
+}
+
+/* Maps file pages around PAGE, a file page that was just faulted
+   in for reading, so that they do not fault in turn.
+
+   Pages in the FAULT_AROUND-page block around PAGE that are cached
+   are mapped to their frames.  Those that follow PAGE in the same
+   file, and so are next on disk, are read as well, as far as the
+   end of the block, or further when the process has been faulting
+   on consecutive pages: each fault on the page just past the last
+   one mapped doubles the distance, up to PREFETCH_MAX pages.  Only
+   free frames are used, never evicting anything.  Pages that are
+   not in the same run of the same file as PAGE are left alone. */
+static void
+vm_fault_around (struct supplemental_page_table *spt, struct page *page) {
+	const struct file_page *origin = &page->file;
+	uint8_t *start = (uint8_t *) page->va
+		- (pg_no (page->va) % FAULT_AROUND) * PGSIZE;
+	uint8_t *end = start + FAULT_AROUND * PGSIZE;
+	uint8_t *next = (uint8_t *) page->va + PGSIZE;
+	bool read = true;
+	struct page *p;
+
+	if ((uint8_t *) page->va == spt->seq_next) {
+		spt->seq_window = spt->seq_window != 0 ? spt->seq_window * 2
+			: FAULT_AROUND;
+		if (spt->seq_window > PREFETCH_MAX)
+			spt->seq_window = PREFETCH_MAX;
+	} else
+		spt->seq_window = 0;
+	if (next + spt->seq_window * PGSIZE > end)
+		end = next + spt->seq_window * PGSIZE;
+
+	for (p = spt_find_range (spt, start, end);
+			p != NULL && (uint8_t *) p->va < end;
+			p = spt_next_page (spt, p)) {
+		const struct file_page *source = page_file_source (p);
+		ptrdiff_t delta = (uint8_t *) p->va - (uint8_t *) page->va;
+
+		if (p == page || p->frame != NULL || source == NULL
+				|| source->inode != origin->inode
+				|| source->ofs - origin->ofs != delta)
+			continue;
+
+		if (vm_share_file_frame (p, source)) {
+			if (!vm_map_file_frame (p))
+				continue;
+		} else {
+			struct frame *frame;
+
+			if (!read || delta < 0)
+				continue;
+			frame = vm_get_free_frame ();
+			if (frame == NULL || !vm_fill_frame (p, frame, true)) {
+				read = false;
+				continue;
+			}
+			prefetch_cnt++;
+		}
+		vm_unpin_frame (p->frame);
+		fault_around_cnt++;
+		if ((uint8_t *) p->va >= next)
+			next = (uint8_t *) p->va + PGSIZE;
+	}
+	spt->seq_next = next;
+}
+
+/* Returns true if PAGE may be part of a huge page: it must be a
+   writable anonymous page, and the only page mapping its frame,
+   which must not be pinned.  FRAME_LOCK must be held. */
+static bool
+page_can_promote (struct page *page) {
+	struct frame *frame = page->frame;
+
+	return VM_TYPE (page->operations->type) == VM_ANON && page->writable
+		&& frame != NULL && frame->pin_cnt == 0 && !frame_is_shared (frame);
+}
+
+/* Maps the aligned 2 MB region around PAGE, an anonymous page
+   that was just faulted in, as a huge page, if every page in it
+   qualifies (see page_can_promote()).  The pages are copied into
+   a physically contiguous block from the user pool, which their
+   frames then point into, and their old frames are freed.  Does
+   nothing if there is no such block free: this is only ever worth
+   doing with memory to spare. */
+static void
+vm_try_promote (struct supplemental_page_table *spt, struct page *page) {
+	uint8_t *start = hpg_round_down (page->va);
+	uint8_t *end = start + HPGSIZE;
+	uint64_t *pml4 = page->owner->pml4;
+	struct page *first, *last, *p;
+	uint8_t *kva;
+	size_t i;
+
+	if (end > (uint8_t *) KERN_BASE)
+		return;
+
+	lock_acquire (&frame_lock);
+
+	/* A region filled in order, upward or downward, is full only
+	   once both of its ends are in, so check those first. */
+	first = spt_find_page (spt, start);
+	last = spt_find_page (spt, end - PGSIZE);
+	if (first == NULL || last == NULL || !page_can_promote (first)
+			|| !page_can_promote (last) || pml4_is_huge (pml4, start))
+		goto done;
+	for (p = first, i = 0; i < HPG_PAGES; p = spt_next_page (spt, p), i++)
+		if (p == NULL || (uint8_t *) p->va != start + i * PGSIZE
+				|| !page_can_promote (p))
+			goto done;
+
+	kva = palloc_get_multiple (PAL_USER, HPG_PAGES);
+	if (kva == NULL)
+		goto done;
+	for (p = first, i = 0; i < HPG_PAGES; p = spt_next_page (spt, p), i++)
+		memcpy (kva + i * PGSIZE, p->frame->kva, PGSIZE);
+	if (!pml4_set_huge_page (pml4, start, kva, true)) {
+		palloc_free_multiple (kva, HPG_PAGES);
+		goto done;
+	}
+	for (p = first, i = 0; i < HPG_PAGES; p = spt_next_page (spt, p), i++) {
+		palloc_free_page (p->frame->kva);
+		p->frame->kva = kva + i * PGSIZE;
+	}
+	huge_promote_cnt++;
+
+done:
+	lock_release (&frame_lock);
+}
+
+/* Makes every page that overlaps the SIZE bytes at BUFFER present
+   and pins its frame, so that kernel code can access the buffer
+   without faulting, for example while holding locks that eviction
+   may need.  If WRITE, the pages must be writable, and any that
+   are shared copy-on-write are copied first.  Returns false,
+   with nothing pinned, if some page is not in the current
+   process's address space. */
+bool
+vm_pin_buffer (const void *buffer, size_t size, bool write) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *start = pg_round_down (buffer);
+	uint8_t *end = (uint8_t *) buffer + size;
+	uint8_t *va;
+
+	if (size == 0)
+		return true;
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+		const void *addr = va < (uint8_t *) buffer ? buffer : va;
+		bool present;
+
+		if (page == NULL
+				&& is_stack_access (addr, thread_current ()->user_rsp)
+				&& vm_stack_growth (va))
+			page = spt_find_page (spt, va);
+
+		if (page == NULL || (write && !page->writable)) {
+			vm_unpin_buffer (start, va - start);
+			return false;
+		}
+
+		if (write && !vm_handle_wp (page)) {
+			vm_unpin_buffer (start, va - start);
+			return false;
+		}
+
+		lock_acquire (&frame_lock);
+		present = page->frame != NULL;
+		if (present)
+			page->frame->pin_cnt++;
+		lock_release (&frame_lock);
+
+		if (!present && !vm_claim_for (page, write)) {
+			vm_unpin_buffer (start, va - start);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Unpins the pages pinned by vm_pin_buffer (BUFFER, SIZE). */
+void
+vm_unpin_buffer (const void *buffer, size_t size) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *va = pg_round_down (buffer);
+	uint8_t *end = (uint8_t *) buffer + size;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	if (size == 0)
+		return;
+	lock_acquire (&frame_lock);
+	for (; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+		if (page != NULL && page->frame != NULL) {
+			ASSERT (page->frame->pin_cnt > 0);
+			page->frame->pin_cnt--;
+		}
+	}
+	lock_release (&frame_lock);
+}
 
-	return swap_in (page, frame->kva);
+/* Prints frame table and eviction statistics. */
+void
+vm_print_stats (void) {
+	printf ("Frames: %zu in use, %llu evictions (%llu dirty), "
+			"%llu second chances\n",
+			list_size (&frame_table), evict_cnt, evict_dirty_cnt,
+			second_chance_cnt);
+	printf ("Fork: %llu pages shared copy-on-write, %llu copied\n",
+			cow_share_cnt, cow_copy_cnt);
+	printf ("File frames: %zu cached, %llu faults served from cache\n",
+			hash_size (&file_frames), file_share_cnt);
+	printf ("Fault-around: %llu pages mapped, %llu of them read ahead\n",
+			fault_around_cnt, prefetch_cnt);
+	printf ("Mappings: %llu pages written back in batches\n",
+			write_back_cnt);
+	printf ("Huge pages: %llu made, %llu split\n",
+			huge_promote_cnt, huge_demote_cnt);
+	printf ("Stack: %llu growths, %llu pages mapped ahead\n",
+			stack_grow_cnt, stack_ahead_cnt);
+	vm_anon_print_stats ();
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	hash_init (&spt->pages, page_hash, page_less, NULL);
+	tree_init (&spt->ranges, page_range_less, NULL);
+	spt->seq_next = NULL;
+	spt->seq_window = 0;
+	/* setup_stack() maps the stack's first page. */
+	spt->stack_bottom = (uint8_t *) USER_STACK - PGSIZE;
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copies PARENT, a page that has not been loaded yet, into the
+   current process's supplemental page table.  An anonymous page
+   must have no aux, which there would be no way to copy. */
+static bool
+spt_copy_uninit (struct page *parent) {
+	struct file_page *aux;
+
+	if (VM_TYPE (parent->uninit.type) != VM_FILE) {
+		ASSERT (parent->uninit.aux == NULL);
+		return vm_alloc_page_with_initializer (parent->uninit.type,
+				parent->va, parent->writable, parent->uninit.init, NULL);
+	}
+
+	aux = malloc (sizeof *aux);
+	if (aux == NULL)
+		return false;
+	*aux = *(struct file_page *) parent->uninit.aux;
+	inode_reopen (aux->inode);
+	if (!vm_alloc_page_with_initializer (parent->uninit.type, parent->va,
+				parent->writable, NULL, aux)) {
+		inode_close (aux->inode);
+		free (aux);
+		return false;
+	}
+	return true;
+}
+
+/* Copies PARENT, a page that has been evicted, into the current
+   process's supplemental page table without reading it back in:
+   an anonymous copy shares PARENT's swap slot, and a file page is
+   read from its file again when it is needed. */
+static bool
+spt_copy_evicted (struct supplemental_page_table *dst, struct page *parent) {
+	struct page *child = kmem_cache_alloc (page_cache);
+
+	if (child == NULL)
+		return false;
+	memcpy (child, parent, sizeof *child);
+	child->owner = thread_current ();
+	child->frame = NULL;
+	if (!spt_insert_page (dst, child)) {
+		kmem_cache_free (page_cache, child);
+		return false;
+	}
+	if (VM_TYPE (child->operations->type) == VM_FILE)
+		inode_reopen (child->file.inode);
+	else
+		anon_copy_swapped (child);
+	return true;
+}
+
+/* Copy supplemental page table from src to dst
+ *
+ * Instead of copying page contents, every resident page of SRC
+ * has its frame shared with the copy, read-only in both processes,
+ * until one of them writes to it (see vm_handle_wp()).  Pages that
+ * have not been loaded yet, or have been evicted, are copied as
+ * they are instead, so that fork() reads nothing from disk, and
+ * the pages of shared file mappings stay writable.  Must be called
+ * by the thread that owns DST, while SRC's owner waits for it. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct thread *curr = thread_current ();
+	struct hash_iterator i;
+
+	dst->stack_bottom = src->stack_bottom;
+	hash_first (&i, &src->pages);
+	while (hash_next (&i)) {
+		struct page *parent = hash_entry (hash_cur (&i), struct page, spt_elem);
+		struct page *child;
+		struct frame *frame;
+		bool present, shared;
+
+		if (VM_TYPE (parent->operations->type) == VM_UNINIT
+				&& (VM_TYPE (parent->uninit.type) == VM_FILE
+					|| parent->uninit.aux == NULL)) {
+			if (!spt_copy_uninit (parent))
+				return false;
+			continue;
+		}
+
+		/* The parent's mapping becomes read-only below, which a
+		   huge page would impose on the whole region. */
+		lock_acquire (&frame_lock);
+		present = parent->frame != NULL;
+		if (present) {
+			parent->frame->pin_cnt++;
+			page_demote (parent);
+		}
+		lock_release (&frame_lock);
+		if (!present && VM_TYPE (parent->operations->type) != VM_UNINIT) {
+			/* Only its owner, which waits for us, brings it back. */
+			if (!spt_copy_evicted (dst, parent))
+				return false;
+			continue;
+		}
+		if (!present && !vm_claim_pinned (parent))
+			return false;
+		frame = parent->frame;
+
+		child = kmem_cache_alloc (page_cache);
+		if (child == NULL) {
+			vm_unpin_frame (frame);
+			return false;
+		}
+		memcpy (child, parent, sizeof *child);
+		child->owner = curr;
+		child->frame = NULL;
+		if (VM_TYPE (child->operations->type) == VM_FILE)
+			inode_reopen (child->file.inode);
+		if (!spt_insert_page (dst, child)) {
+			kmem_cache_free (page_cache, child);
+			vm_unpin_frame (frame);
+			return false;
+		}
+
+		/* Pages of shared mappings stay writable: they are meant to
+		   see each other's writes. */
+		shared = page_is_shared_file (parent);
+		lock_acquire (&frame_lock);
+		frame_add_page (frame, child);
+		if (parent->writable && !shared)
+			pml4_set_writable (parent->owner->pml4, parent->va, false);
+		lock_release (&frame_lock);
+
+		if (!pml4_set_page (curr->pml4, child->va, frame->kva,
+					child->writable && shared)) {
+			spt_remove_page (dst, child);
+			vm_unpin_frame (frame);
+			return false;
+		}
+		vm_unpin_frame (frame);
+		cow_share_cnt++;
+	}
+	return true;
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Destroys the page that E is in, for hash_destroy(). */
+static void
+spt_destroy_page (struct hash_elem *e, void *aux UNUSED) {
+	vm_release_page (hash_entry (e, struct page, spt_elem));
+}
+
+/* A page being written back by spt_write_back(). */
+struct write_back {
+	struct page *page;
+	struct frame *frame;
+};
+
+/* qsort() comparison function for struct write_back, ordering by
+   inode number, and so roughly by disk position, then offset. */
+static int
+write_back_cmp (const void *a_, const void *b_) {
+	const struct file_page *a = &((const struct write_back *) a_)->page->file;
+	const struct file_page *b = &((const struct write_back *) b_)->page->file;
+	disk_sector_t a_sector = inode_get_inumber (a->inode);
+	disk_sector_t b_sector = inode_get_inumber (b->inode);
+
+	if (a_sector != b_sector)
+		return a_sector < b_sector ? -1 : 1;
+	return a->ofs < b->ofs ? -1 : a->ofs > b->ofs;
+}
+
+/* Cleans and pins the frames of the CNT pages in BATCH that are
+   resident and dirty, then writes them back in the order of the
+   files on disk, so that the disk sweeps across them once instead
+   of seeking to and fro as a page at a time would.  Frees BATCH. */
+static void
+write_back_batch (struct write_back *batch, size_t cnt) {
+	size_t i, n = 0;
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < cnt; i++) {
+		struct frame *frame = batch[i].page->frame;
+
+		if (frame == NULL || !frame_test_and_clean (frame))
+			continue;
+		frame->pin_cnt++;
+		batch[n].page = batch[i].page;
+		batch[n].frame = frame;
+		n++;
+	}
+	lock_release (&frame_lock);
+
+	qsort (batch, n, sizeof *batch, write_back_cmp);
+	for (i = 0; i < n; i++) {
+		file_backed_write_back (&batch[i].page->file, batch[i].frame->kva);
+		vm_unpin_frame (batch[i].frame);
+	}
+	write_back_cnt += n;
+	free (batch);
+}
+
+/* Writes back the dirty frames of the shared file mappings in SPT
+   between START and END, in one batch (see write_back_batch()). */
+void
+spt_write_back (struct supplemental_page_table *spt, void *start, void *end) {
+	struct write_back *batch;
+	size_t cnt = 0, max = 0;
+	struct page *page;
+
+	for (page = spt_find_range (spt, start, end);
+			page != NULL && page->va < end; page = spt_next_page (spt, page))
+		if (page_is_shared_file (page))
+			max++;
+	if (max == 0)
+		return;
+
+	batch = malloc (max * sizeof *batch);
+	if (batch == NULL) {
+		/* Nowhere to queue them, so write each right away. */
+		lock_acquire (&frame_lock);
+		for (page = spt_find_range (spt, start, end);
+				page != NULL && page->va < end; page = spt_next_page (spt, page))
+			if (page->frame != NULL && page_is_shared_file (page)
+					&& frame_test_and_clean (page->frame))
+				file_backed_write_back (&page->file, page->frame->kva);
+		lock_release (&frame_lock);
+		return;
+	}
+
+	for (page = spt_find_range (spt, start, end);
+			page != NULL && page->va < end; page = spt_next_page (spt, page))
+		if (page_is_shared_file (page))
+			batch[cnt++].page = page;
+	write_back_batch (batch, cnt);
+}
+
+/* Free the resource hold by the supplemental page table.
+ * Runs in time linear in the number of pages, apart from sorting
+ * the resident pages of shared file mappings for write-back: the
+ * hash table is walked once to find those and once to free every
+ * page, and the ordered index, whose elements live in the pages,
+ * is simply forgotten.  SPT must be initialized again before it
+ * is reused. */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct write_back *batch = NULL;
+	size_t cnt = 0, max = 0;
+	struct hash_iterator i;
+
+	hash_first (&i, &spt->pages);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, spt_elem);
+
+		if (page->frame == NULL || !page_is_shared_file (page))
+			continue;
+		if (cnt == max) {
+			/* Pages left out are written back one at a time as
+			   they are freed. */
+			size_t new_max = max != 0 ? max * 2 : 16;
+			struct write_back *grown = realloc (batch, new_max * sizeof *batch);
+			if (grown == NULL)
+				break;
+			batch = grown;
+			max = new_max;
+		}
+		batch[cnt++].page = page;
+	}
+	if (cnt > 0)
+		write_back_batch (batch, cnt);
+	else
+		free (batch);
+
+	hash_destroy (&spt->pages, spt_destroy_page);
+	tree_init (&spt->ranges, page_range_less, NULL);
 }